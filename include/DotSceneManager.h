@@ -31,12 +31,84 @@
 #   endif
 
 #define DOTSCENE_MAX_VIEWPORTS  8
+/** node handle never resolved */
+#define DOTSCENE_INVALID_HANDLE 0xFFFFFFFF
+
+/****************************************************************************/
+// Scene creation options (DotSceneManager::createScene 'options' parameter)
+/** build triangle ray query accelerators at load time, meshes loaded with shadow buffers ("true"/"false") */
+#define DOTSCENE_OPTION_RAYCAST_AT_LOAD     "raycastAtLoad"
+/** scene resource group is private: released in bulk when its last scene unloads ("true"/"false") */
+#define DOTSCENE_OPTION_PRIVATE_GROUP       "privateResourceGroup"
+/** batch entities marked static="true" into StaticGeometry regions ("true"/"false") */
+#define DOTSCENE_OPTION_STATIC_BATCHING     "staticBatching"
+/** static batching region size (world units) */
+#define DOTSCENE_OPTION_STATIC_REGION_SIZE  "staticRegionSize"
+/** 
+ * create repeated mesh/material entities through InstanceManager ("true"/"false"), 
+ * only pairs whose material has an instancing variant named "<material>/Instanced"
+ */
+#define DOTSCENE_OPTION_INSTANCING              "instancing"
+/** minimum mesh/material repetitions to use instancing */
+#define DOTSCENE_OPTION_INSTANCING_THRESHOLD    "instancingThreshold"
+/** instancing technique: "shaderbased", "vtf", "hwbasic", "hwvtf" */
+#define DOTSCENE_OPTION_INSTANCING_TECHNIQUE    "instancingTechnique"
+/** instances per batch (reduced by Ogre if technique can't reach it) */
+#define DOTSCENE_OPTION_INSTANCING_BATCH_SIZE   "instancingBatchSize"
+/** apply viewports, cameras, ambient light & environment on load ("true"/"false") */
+#define DOTSCENE_OPTION_APPLY_GLOBAL_STATE      "applyGlobalState"
+/** keep parsed .scene document while scene is loaded: instantiation never reparses ("true"/"false") */
+#define DOTSCENE_OPTION_KEEP_DOCUMENT           "keepDocument"
+/** scene root node position ("x y z") */
+#define DOTSCENE_OPTION_POSITION                "position"
+/** scene root node orientation ("w x y z") */
+#define DOTSCENE_OPTION_ORIENTATION             "orientation"
+/** scene root node scale ("x y z") */
+#define DOTSCENE_OPTION_SCALE                   "scale"
+/** 
+ * generate LOD levels for meshes without them & assign rendering distances ("true"/"false");
+ * LOD levels of a mesh shared by scenes follow the policy of the first scene loading it,
+ * entities in <staticGeometries>/<instancedGeometries> use the geometry rendering distance & no LOD bias
+ */
+#define DOTSCENE_OPTION_LOD_GENERATION          "lodGeneration"
+/** LOD generation policy preset: "low", "medium", "high" (overridden by next options) */
+#define DOTSCENE_OPTION_LOD_QUALITY             "lodQuality"
+/** LOD levels generated */
+#define DOTSCENE_OPTION_LOD_LEVELS              "lodLevels"
+/** vertex reduction by LOD level (0..1) */
+#define DOTSCENE_OPTION_LOD_REDUCTION           "lodReduction"
+/** first LOD level distance (bounding radius units) */
+#define DOTSCENE_OPTION_LOD_DISTANCE            "lodDistance"
+/** entity rendering distance (bounding radius units, 0: unlimited) */
+#define DOTSCENE_OPTION_LOD_RENDERING_DISTANCE  "lodRenderingDistance"
+/** advance skeletal animations of dynamic entities on update at distance based rates ("true"/"false") */
+#define DOTSCENE_OPTION_ANIMATION_LOD           "animationLod"
+/** skeletal animation full rate distance (world units, entity userData "animationLodDistance" overrides) */
+#define DOTSCENE_OPTION_ANIMATION_LOD_DISTANCE  "animationLodDistance"
+/** max frames between skeletal animation updates (far & off-screen entities) */
+#define DOTSCENE_OPTION_ANIMATION_LOD_INTERVAL  "animationLodInterval"
 
 /****************************************************************************/
 // Forward declarations
 class TiXmlElement;
 // Forward declarations
+class TiXmlDocument;
+// Forward declarations
 class DotScenePersistenceHelper;
+// Forward declarations
+class DotSceneMeshBVH;
+// Forward declarations
+class DotSceneArena;
+// Forward declarations
+class DotSceneConstraintEngine;
+// Forward declarations
+class DotSceneUpdatePool;
+// Forward declarations
+class DotSceneBoundsCache;
+// Forward declarations
+class DotSceneTransformSnapshot;
+// Forward declarations
+class DotSceneStringEntry;
 
 namespace Ogre {
 
@@ -73,17 +145,106 @@ namespace Ogre {
         UNKNOWN=99
     } NodePropertyType;         
     
+    /** 
+     * Interned string handle: equal strings share one pooled copy (global, thread safe),
+     * so copies are a pointer and comparisons between handles are pointer compares;
+     * empty handles use a static entry (no pool access)
+     */
+    class _DotSceneManagerExport DotSceneString
+    {
+    public:
+        /** Constructor: empty string */
+        DotSceneString();
+        /** Constructor: intern string */
+        DotSceneString(const String& str);
+        /** Constructor: intern string */
+        DotSceneString(const char* str);
+        /** Constructor */
+        DotSceneString(const DotSceneString& other);
+        /** Destructor: pooled copy is released with its last handle */
+        ~DotSceneString();
+        
+        /** Assignment */
+        DotSceneString& operator=(const DotSceneString& other);
+        
+        /** return pooled string */
+        const String& str() const;
+        /** return pooled string */
+        operator const String&() const { return str(); }
+        /** return pooled string */
+        const char* c_str() const { return str().c_str(); }
+        /** return true for empty string */
+        bool empty() const { return str().empty(); }
+        
+        /** compare handles (pointer compare) */
+        bool operator==(const DotSceneString& other) const { return mEntry == other.mEntry; }
+        /** compare handles (pointer compare) */
+        bool operator!=(const DotSceneString& other) const { return mEntry != other.mEntry; }
+        /** compare with pooled entry returned by find (pointer compare) */
+        bool operator==(const DotSceneStringEntry* entry) const { return mEntry == entry; }
+        /** lexicographical order */
+        bool operator<(const DotSceneString& other) const { return str() < other.str(); }
+        
+        /** 
+         * get handle for an already pooled string (never inserts) 
+         * @return false if no handle references that string
+         */
+        static bool find(const String& str, DotSceneString& handle);
+        /** 
+         * return pooled entry of a string or null, without taking a reference (no handle churn):
+         * only meant to be compared with handles kept alive by caller
+         */
+        static const DotSceneStringEntry* find(const String& str);
+        /** return number of strings in pool */
+        static size_t getPoolSize();
+        /** return bytes used by pool (strings & bookkeeping) */
+        static size_t getPoolMemory();
+    private:
+        /** Pooled string */
+        const DotSceneStringEntry* mEntry;
+    }; //DotSceneString
+    
+    /** compare interned string */
+    inline bool operator==(const DotSceneString& a, const String& b) { return a.str() == b; }
+    /** compare interned string */
+    inline bool operator==(const String& a, const DotSceneString& b) { return a == b.str(); }
+    /** compare interned string */
+    inline bool operator==(const DotSceneString& a, const char* b) { return a.str() == b; }
+    /** compare interned string */
+    inline bool operator==(const char* a, const DotSceneString& b) { return a == b.str(); }
+    /** compare interned string */
+    inline bool operator!=(const DotSceneString& a, const String& b) { return a.str() != b; }
+    /** compare interned string */
+    inline bool operator!=(const String& a, const DotSceneString& b) { return a != b.str(); }
+    /** compare interned string */
+    inline bool operator!=(const DotSceneString& a, const char* b) { return a.str() != b; }
+    /** compare interned string */
+    inline bool operator!=(const char* a, const DotSceneString& b) { return a != b.str(); }
+    /** concat interned string */
+    inline String operator+(const DotSceneString& a, const DotSceneString& b) { return a.str() + b.str(); }
+    /** concat interned string */
+    inline String operator+(const DotSceneString& a, const String& b) { return a.str() + b; }
+    /** concat interned string */
+    inline String operator+(const String& a, const DotSceneString& b) { return a + b.str(); }
+    /** concat interned string */
+    inline String operator+(const DotSceneString& a, const char* b) { return a.str() + b; }
+    /** concat interned string */
+    inline String operator+(const char* a, const DotSceneString& b) { return a + b.str(); }
+    
+    /** Datatype interned string list */
+    typedef std::vector<DotSceneString> DotSceneStringVector;
+    
     /** Base node property */
     struct _DotSceneManagerExport NodeProperty        
     {
-        String mReference;
-        String mName;
-        String mValue;
+        DotSceneString mReference;
+        DotSceneString mName;
+        DotSceneString mValue;
         NodePropertyType mType;
         
-        NodeProperty(const String &reference,
-                     const String &name, 
-                     const String &value, 
+        NodeProperty(const DotSceneString &reference,
+                     const DotSceneString &name, 
+                     const DotSceneString &value, 
                      NodePropertyType type=UNKNOWN)
                      :mReference(reference), mName(name), mValue(value), mType(type) {}
     };//struct nodeProperty
@@ -92,10 +253,17 @@ namespace Ogre {
     struct SceneNodeProperty : NodeProperty
     {
         SceneNodeProperty(T* node,
-                          const String &name, 
-                          const String &value, 
+                          const DotSceneString &name, 
+                          const DotSceneString &value, 
                           NodePropertyType type=UNKNOWN)
                          :NodeProperty(node->getName(),name,value,type), mNode(node){}
+        /** Constructor: object referenced by scene name (Ogre generated name differs) */
+        SceneNodeProperty(T* node,
+                          const DotSceneString &reference, 
+                          const DotSceneString &name, 
+                          const DotSceneString &value, 
+                          NodePropertyType type)
+                         :NodeProperty(reference,name,value,type), mNode(node){}
         T* mNode;
     }; //SceneNodeProperty
     
@@ -104,6 +272,108 @@ namespace Ogre {
     /** Datatype property list iterator */
     typedef std::vector<NodeProperty*>::iterator PropertyListIterator;
     
+    /** Datatype ray query result */
+    struct _DotSceneManagerExport DotSceneRaycastHit
+    {
+        /** Entity hit (null if the ray hits nothing) */
+        Ogre::Entity* mEntity;
+        /** Index of the sub-entity hit */
+        unsigned int mSubEntity;
+        /** Index of the triangle hit inside the sub-entity */
+        unsigned int mTriangle;
+        /** Distance from ray origin to hit point (world units) */
+        Ogre::Real mDistance;
+        
+        DotSceneRaycastHit():mEntity(0), mSubEntity(0), mTriangle(0), mDistance(0) {}
+    };//struct DotSceneRaycastHit
+    
+    /** Datatype ray query result list */
+    typedef std::vector<DotSceneRaycastHit> DotSceneRaycastHitList;
+    /** Datatype ray list */
+    typedef std::vector<Ray> RayList;
+    
+    /** Datatype bookkeeping allocation counters (per scene) */
+    struct _DotSceneManagerExport DotSceneAllocationStats
+    {
+        /** Bytes reserved by arena blocks */
+        size_t mBytesReserved;
+        /** Bytes in use by current load */
+        size_t mBytesInUse;
+        /** Live objects owned by the arena */
+        size_t mObjects;
+        /** Allocations served since creation */
+        size_t mAllocations;
+        /** Blocks requested to the system since creation (constant on steady state) */
+        size_t mBlockAllocations;
+        /** Bulk releases (one by unload) */
+        size_t mReleases;
+        
+        DotSceneAllocationStats():mBytesReserved(0), mBytesInUse(0), mObjects(0), 
+                                  mAllocations(0), mBlockAllocations(0), mReleases(0) {}
+    };//struct DotSceneAllocationStats
+    
+    /** Datatype shared resource category */
+    typedef enum
+    {
+        RESOURCE_MESH,
+        RESOURCE_MATERIAL,
+        RESOURCE_TEXTURE,
+        RESOURCE_PARTICLE_TEMPLATE,
+        RESOURCE_TYPE_COUNT
+    } DotSceneResourceType;
+    
+    /** Datatype resource names used by a scene */
+    typedef std::set<DotSceneString> DotSceneResourceSet;
+    
+    /** Datatype memory usage by category (bytes) */
+    struct _DotSceneManagerExport DotSceneMemoryBreakdown
+    {
+        /** Library structures: object lists, properties, indexes, ray accelerators */
+        size_t mBookkeeping;
+        /** Ogre objects created by the scene: nodes, entities, lights, cameras, particles... */
+        size_t mSceneObjects;
+        /** Meshes (shared by n scenes: 1/n attributed to each scene) */
+        size_t mMeshes;
+        /** Materials (shared by n scenes: 1/n attributed to each scene) */
+        size_t mMaterials;
+        /** Textures (shared by n scenes: 1/n attributed to each scene) */
+        size_t mTextures;
+        
+        DotSceneMemoryBreakdown():mBookkeeping(0), mSceneObjects(0), mMeshes(0), mMaterials(0), mTextures(0) {}
+        
+        /** return total bytes */
+        size_t getTotal() const { return mBookkeeping + mSceneObjects + mMeshes + mMaterials + mTextures; }
+        
+        /** accumulate breakdown */
+        DotSceneMemoryBreakdown& operator+=(const DotSceneMemoryBreakdown& other)
+        {
+            mBookkeeping += other.mBookkeeping;
+            mSceneObjects += other.mSceneObjects;
+            mMeshes += other.mMeshes;
+            mMaterials += other.mMaterials;
+            mTextures += other.mTextures;
+            return *this;
+        }
+    };//struct DotSceneMemoryBreakdown
+    
+    /** Datatype automatic LOD generation policy (distances in bounding radius units) */
+    struct _DotSceneManagerExport DotSceneLodPolicy
+    {
+        /** LOD levels generated (besides full detail) */
+        unsigned short mLevels;
+        /** Vertex reduction by level (proportion of previous level removed) */
+        Ogre::Real mReduction;
+        /** Distance of first LOD level, next levels at multiples */
+        Ogre::Real mLodDistance;
+        /** Rendering distance of entities without 'renderingDistance' (0: unlimited) */
+        Ogre::Real mRenderingDistance;
+        
+        DotSceneLodPolicy(unsigned short levels=3, Ogre::Real reduction=0.5f, 
+                          Ogre::Real lodDistance=10.0f, Ogre::Real renderingDistance=100.0f)
+            :mLevels(levels), mReduction(reduction), 
+             mLodDistance(lodDistance), mRenderingDistance(renderingDistance) {}
+    };//struct DotSceneLodPolicy
+    
     /** Datatype clip planes */
     typedef struct 
     { 
@@ -125,6 +395,22 @@ namespace Ogre {
             UP_AXIS_X
         } UpAxisType;
         
+        /** Listener: note track events (called from update on main thread) */
+        class _DotSceneManagerExport NoteListener
+        {
+        public:
+            virtual ~NoteListener() {}
+            /** 
+             * notes reached by a note track (all notes at same time in one call)
+             * @param object scene object name owning the track
+             * @param track note track name
+             * @param time notes time (track clock)
+             * @param notes notes text
+             */
+            virtual void notesReached(DotScene* scene, const String& object, const String& track, 
+                                      Ogre::Real time, const Ogre::StringVector& notes) = 0;
+        }; //Class NoteListener
+        
     public:
         /** Constructor */
         DotScene(Ogre::ResourceManager* creator, 
@@ -145,15 +431,23 @@ namespace Ogre {
         /** @return scene root node */
         Ogre::SceneNode* getRootSceneNode();
      
-        /** Change scene visibility status  - attach to Ogre::RootSceneNode*/
+        /** Change scene visibility status  - attach to Ogre::RootSceneNode (reloads evicted scene) */
         void setVisible(bool visible);
         /** Get scene visibility status */
         bool getVisible(void);
         
         /** return Ogre::SceneNode in scene or null */
         Ogre::SceneNode* getSceneNode(const String& sceneNode);
-        /** return Ogre::Entity in scene or null */
+        /** return Ogre::Entity in scene or null (null for entities created by automatic instancing: see getInstancedEntity) */
         Ogre::Entity* getEntity(const String& entity);
+        /** return Ogre::InstancedEntity in scene (created by automatic instancing) or null */
+        Ogre::InstancedEntity* getInstancedEntity(const String& entity);
+        /** return Ogre::StaticGeometry declared in <staticGeometries> or built by static batching, or null */
+        Ogre::StaticGeometry* getStaticGeometry(const String& geometry);
+        /** return Ogre::InstancedGeometry declared in <instancedGeometries> or null */
+        Ogre::InstancedGeometry* getInstancedGeometry(const String& geometry);
+        /** return Ogre::AnimationState of node animation declared in <animations> or null */
+        Ogre::AnimationState* getAnimationState(const String& animation);
         /** return Ogre::Light in scene or null */
         Ogre::Light* getLight(const String& light);
         /** return Ogre::Camera in scene or null */
@@ -175,16 +469,146 @@ namespace Ogre {
         /** return la lista  de propiedades de un nodo de la escena */
         bool getPropertyBool(const String& node, const String& name);
         
+        /** 
+         * return objects whose name (without scene prefix) starts with prefix 
+         * @param type object type filter (UNKNOWN for any type)
+         */
+        StringVector findObjectsByPrefix(const String& prefix, NodePropertyType type=UNKNOWN);
+        /** 
+         * return objects below a hierarchy path such as "Nodes/Building_12/" 
+         * @param type object type filter (UNKNOWN for any type)
+         */
+        StringVector findObjectsUnderPath(const String& path, NodePropertyType type=UNKNOWN);
+        /** return object name for a hierarchy path such as "Nodes/Building_12/Door" or blank */
+        const String& resolvePath(const String& path, NodePropertyType* type=0);
+        /** return Ogre::SceneNode for a hierarchy path or null */
+        Ogre::SceneNode* getSceneNodeByPath(const String& path);
+        
+        /** 
+         * scene node handle: load generation (8 bits) | index (24 bits), stale once scene unloads or node 
+         * is destroyed (detected through scene node listener: not for nodes with application listener);
+         * generation wraps every 256 loads, handles must not be kept across so many reloads
+         */
+        typedef Ogre::uint32 NodeHandle;
+        /** datatype transform write (node local space) */
+        typedef struct
+        {
+            /** Target node */
+            NodeHandle mHandle;
+            /** Position */
+            Ogre::Vector3 mPosition;
+            /** Orientation */
+            Ogre::Quaternion mOrientation;
+            /** Scale */
+            Ogre::Vector3 mScale;
+        } NodeTransform;
+        
+        /** return handle of scene node (name with or without scene prefix), DOTSCENE_INVALID_HANDLE if not found */
+        NodeHandle getNodeHandle(const String& sceneNode);
+        /** resolve many scene node names at once (same order, DOTSCENE_INVALID_HANDLE if not found) */
+        void getNodeHandles(const StringVector& sceneNodes, std::vector<NodeHandle>& handles);
+        /** return scene node of handle or null (stale handle) */
+        Ogre::SceneNode* getSceneNode(NodeHandle handle);
+        /** internal method: scene node destroyed (its handle becomes stale) */
+        void _notifyNodeDestroyed(const Ogre::Node* node);
+        /** 
+         * write position, orientation & scale of many nodes in one call (unchanged components are skipped)
+         * @return transforms applied (stale handles are ignored)
+         */
+        size_t applyTransforms(const NodeTransform* transforms, size_t count);
+        
+        /** 
+         * publish world transforms of nodes once per frame, after scene graph update (empty: stop publishing)
+         * (snapshot buffers are reallocated: readers must not run during this call)
+         */
+        void setSnapshotNodes(const std::vector<NodeHandle>& handles);
+        /** publish snapshot now (scene graph updated without rendering) */
+        void publishSnapshot();
+        /** 
+         * copy last published world transforms, in setSnapshotNodes order (thread safe, lock free)
+         * @param frame frame number published (unchanged: stale snapshot)
+         * @return false if nothing published or publisher kept overwriting copy
+         */
+        bool readSnapshot(std::vector<Ogre::Vector3>& positions, std::vector<Ogre::Quaternion>& orientations, 
+                          unsigned long* frame=0) const;
+        /** return frame number of last published snapshot (thread safe, 0: none) */
+        unsigned long getSnapshotFrame() const;
+        
         /** return default camera or null*/
         Ogre::Camera* getDefaultCamera(int viewport=0);
         /** return default camera or null*/
         Ogre::Camera* setDefaultCamera(const String& camera, int viewport=0, int zorder=0);
         
-        /** change camera in viewport */
+        /** change camera in viewport (optionally moved to frame whole scene) */
         void viewSceneFromCamera(const String& camera, bool fitToWholeScene=false);
+        /** 
+         * return world bounds of scene or a node subtree (blank: whole scene), 
+         * cached by subtree until any of its nodes moves
+         * (scene nodes Node::Listener is used by cache: subtrees with application listeners are computed on each call)
+         */
+        const Ogre::AxisAlignedBox& getWorldBounds(const String& node=StringUtil::BLANK);
+        /** 
+         * find nodes created/attached in a subtree (blank: whole scene) by application since load,  
+         * or whose listener has been replaced: Ogre doesn't notify parents, call it after such changes
+         */
+        void refreshWorldBounds(const String& node=StringUtil::BLANK);
+        /** move camera along its direction to frame scene or a node subtree (perspective & orthographic) */
+        void fitCamera(const String& camera, const String& node=StringUtil::BLANK);
         
-        /** update scene node behaviours: lookTarget, TrackTarget, camera best-fits */
+        /** update scene node behaviours: node animations, lookTarget, TrackTarget, camera best-fits */
         void update(Real delta);
+        /** 
+         * internal method: update first phase, solve behaviours without modifying Ogre objects 
+         * (thread safe among scenes) 
+         */
+        void _prepareUpdate(Real delta);
+        /** internal method: update second phase (main thread), write prepared results to Ogre */
+        void _applyUpdate(Real delta);
+        /** return time spent in last update (microseconds, both phases) */
+        unsigned long getLastUpdateTime() const;
+        
+        /** 
+         * sleep/wake scene: sleeping scene is hidden, its updates are skipped, node & skeletal 
+         * animation states are disabled, particle systems frozen and render textures not auto updated;
+         * waking restores them as they were (sleeping scenes are never evicted by memory budget)
+         * @param fastForward on wake, max seconds slept to simulate in particle systems (0: resume frozen)
+         */
+        void setSleeping(bool sleeping, Real fastForward=0);
+        /** return true if scene is sleeping */
+        bool getSleeping() const;
+        
+        /** 
+         * show/hide a layer: named visibility flags declared in <visibilityFlags> or by objects 
+         * userData "layer" (toggled by viewports visibility mask, objects aren't touched);
+         * a layer name has the same bit in all scenes and stays hidden while any scene hides it
+         */
+        void setLayerVisible(const String& layer, bool visible);
+        /** return true if layer is visible */
+        bool getLayerVisible(const String& layer) const;
+        /** return visibility flags of layer (0 if unknown) */
+        Ogre::uint32 getLayerFlags(const String& layer) const;
+        /** return layer names */
+        Ogre::StringVector getLayers() const;
+        
+        /** add note track listener */
+        void addNoteListener(NoteListener* listener);
+        /** remove note track listener */
+        void removeNoteListener(NoteListener* listener);
+        
+        /** 
+         * ray query against entity triangles (meshes are tested in bind pose) 
+         * (instanced entities and entities of static/instanced geometry sections are not tested, 
+         * nor submeshes whose buffers have no shadow copy: see DOTSCENE_OPTION_RAYCAST_AT_LOAD)
+         * @return true if any entity was hit
+         */
+        bool raycast(const Ray& ray, DotSceneRaycastHit& hit, uint32 queryMask=0xFFFFFFFF);
+        /** 
+         * batched ray query against entity triangles: one hit per ray
+         * @return number of rays that hit something
+         */
+        size_t raycast(const RayList& rays, DotSceneRaycastHitList& hits, uint32 queryMask=0xFFFFFFFF);
+        /** build triangle accelerators for all meshes in scene (otherwise built on first query) */
+        void buildRaycastData();
         
         /** debug facilities: show AABB for all entities*/
         void showBoundingBoxes();
@@ -207,9 +631,31 @@ namespace Ogre {
         template<typename T>
         const PropertyList& getObjectProperties(const String& name);
         
+        /** return bookkeeping allocation counters */
+        DotSceneAllocationStats getAllocationStats() const;
+        /** return current memory usage by category (bytes) */
+        DotSceneMemoryBreakdown getMemoryBreakdown() const;
+        /** return names of meshes, materials or textures used by the scene */
+        const DotSceneResourceSet& getResources(DotSceneResourceType type) const;
+        
+        /** return true if scene resource group is released with its last loaded scene */
+        bool isResourceGroupPrivate() const;
+        
+        /** return .scene filename */
+        const String& getFile() const;
+        /** return scene creation options (createScene 'options' & internal parameters) */
+        const Ogre::NameValuePairList& getOptions() const;
+        
+        /** return true if scene was unloaded by manager memory budget (reloaded on next access) */
+        bool isEvicted() const;
+        /** internal method: unload scene, next load keeps it hidden & skips global state */
+        void _evict();
+        
         /** 
-         * export current scene to a .scene file 
-         * @param String filename
+         * export current scene to a .scene file: prefab definitions & references are kept,
+         * instances are written with its current transform; everything else is written as authored
+         * (instance 'visible' overrides & userData, instances nested in prefabs)
+         * @param String filename file system path (default: scene file, if found in a file system archive)
          */
         bool exportToFile(const String& filename=StringUtil::BLANK);
         
@@ -218,7 +664,7 @@ namespace Ogre {
         void loadImpl();
         /** Release internal resources */
         void unloadImpl();
-        /** return resource size (in nodes) */
+        /** return resource size (bytes, evaluated at load time) */
         size_t calculateSize() const;
     private:
         /** dotscene loader method: process 'scene' node*/
@@ -243,6 +689,12 @@ namespace Ogre {
         void processCamera(TiXmlElement* node, Ogre::SceneNode* parent);
         /** dotscene loader method: process 'node' node*/
         void processNode(TiXmlElement* node, Ogre::SceneNode* parent);
+        /** dotscene loader method: process 'node' (or 'prefab') content: children & attached objects */
+        void processNodeChildren(TiXmlElement* node, Ogre::SceneNode* sceneNode);
+        /** dotscene loader method: process 'instance' node (prefab reference) */
+        void processInstance(TiXmlElement* node, Ogre::SceneNode* parent);
+        /** index 'prefab' definitions by name */
+        void collectPrefabs(TiXmlElement* node);
         /** dotscene loader method: process 'look-target' node*/
         void processLookTarget(TiXmlElement* node, Ogre::SceneNode* parent);
         /** dotscene loader method: process 'track-target' node*/
@@ -251,6 +703,17 @@ namespace Ogre {
         void processEntity(TiXmlElement* node, Ogre::SceneNode* parent);
         /** dotscene loader method: process 'entity' node*/
         void processEntity(TiXmlElement* node, Ogre::InstancedGeometry* geometry);
+        /** dotscene loader method: create 'entity' node through InstanceManager (null if not possible)*/
+        Ogre::InstancedEntity* processInstancedEntity(TiXmlElement* node, Ogre::SceneNode* parent, const String& name, 
+                                                      const String& mesh, const String& material);
+        /** count mesh/material repetitions & select pairs for automatic instancing */
+        void countInstancingPairs(TiXmlElement* node);
+        /** 
+         * return true if 'entity' node can be created through InstanceManager: settings instanced 
+         * entities don't have (receiveShadows, renderQueue, renderingDistance, subentities, 
+         * buffers, note tracks, custom parameters, bone attachments) keep it as Ogre::Entity
+         */
+        bool isInstanceable(TiXmlElement* node);
         /** dotscene loader method: process 'entity' node*/
         void processEntity(TiXmlElement* node, Ogre::StaticGeometry* geometry);
         /** dotscene loader method: process 'particle-system' node*/
@@ -280,7 +743,7 @@ namespace Ogre {
         /** process animation */
         void processAnimation(TiXmlElement* node, Ogre::SceneNode* parent);
         /** process animation keyframe */
-        void processAnimationKeyFrame(TiXmlElement* node, Ogre::SceneNode* parent);
+        void processAnimationKeyFrame(TiXmlElement* node, Ogre::NodeAnimationTrack* track);
         /** process shadows */
         void processShadow(TiXmlElement* node);
         /** process subentity */
@@ -295,10 +758,10 @@ namespace Ogre {
         void processStaticGeometries(TiXmlElement* node);
         /** process PortalConnectedZones */
         void processPortalConnectedZones(TiXmlElement* node);
+        /** process NoteTracks */
+        void processNoteTracks(TiXmlElement* node, const String& object, Ogre::Entity* entity=0);
         /** process NoteTrack */
-        void processNoteTrack(TiXmlElement* node, Ogre::SceneNode* parent);
-        /** process NoteTrack */
-        void processNoteTrack(TiXmlElement* node, Ogre::Entity* entity);
+        void processNoteTrack(TiXmlElement* node, const String& object, Ogre::Entity* entity);
         /** process CustomParameter */
         void processCustomParameter(TiXmlElement* node, Ogre::Entity* entity);
         /** process BoneAttachment */
@@ -337,17 +800,24 @@ namespace Ogre {
         /** dotscene helper method: parse value to autodetect angle units*/
         Ogre::Radian parseAngleUnit(Real value);
         
-        /** dotscene loader method: process 'userdata' node*/
+        /** dotscene loader method: process 'userdata' node (referenceName: scene name if it isn't object name)*/
         template <typename T>
-        void processUserData(TiXmlElement* node, T* reference, NodePropertyType type);
+        void processUserData(TiXmlElement* node, T* reference, NodePropertyType type, 
+                             const String& referenceName=StringUtil::BLANK);
         
         /** dotscene loader method: process 'userdatareference' node*/
         template <typename T>
-        void processUserDataReference(TiXmlElement* node, T* reference, NodePropertyType type);
+        void processUserDataReference(TiXmlElement* node, T* reference, NodePropertyType type, 
+                                      const String& referenceName=StringUtil::BLANK);
         
         /** dotscene helper method: add runtime property to scene node */
         template<typename T>
-        void addProperty(T* reference, const  String& name, const String& value, NodePropertyType type);
+        void addProperty(T* reference, const  String& name, const String& value, NodePropertyType type, 
+                         const String& referenceName=StringUtil::BLANK);
+        /** dotscene helper method: create property in scene arena */
+        template<typename T>
+        NodeProperty* createProperty(T* reference, const DotSceneString& name, const DotSceneString& value, NodePropertyType type, 
+                                     const String& referenceName=StringUtil::BLANK);
         
         /** clean resources dotscene */
         void cleanResources();
@@ -360,10 +830,66 @@ namespace Ogre {
         /** set default lighting schema */
         void setDefaultLighting();
         
+        /** batch static entities into StaticGeometry regions */
+        void buildStaticBatches();
+        
+        /** return visibility flags of layers list ("a|b", numbers allowed), undeclared layers are created */
+        Ogre::uint32 parseLayerFlags(const String& layers);
+        /** assign userData "layer" of nodes (whole subtree) & objects */
+        void applyLayers();
+        /** set visibility flags of objects in subtree */
+        void setLayerFlags(Ogre::SceneNode* node, Ogre::uint32 flags);
+        
+        /** bind note tracks to animation states named as them (scene clock otherwise) */
+        void bindNoteTracks();
+        /** advance note tracks cursors & dispatch reached notes */
+        void updateNoteTracks(Ogre::Real delta);
+        
+        /** collect skinned dynamic entities scheduled by animation LOD */
+        void buildAnimationLods();
+        /** select skinned entities due this frame (only reads Ogre objects) */
+        void scheduleAnimationLods(Ogre::Real delta);
+        /** advance animations of skinned entities due this frame */
+        void applyAnimationLods();
+        
+        /** 
+         * load mesh & build derived data (tangent vectors, edge list) once: 
+         * read from / written to manager mesh cache when enabled
+         */
+        Ogre::MeshPtr prepareMesh(const String& mesh, bool tangents, bool edgeList, bool lods=false);
+        /** return material (or its variant) with requested flags: shared materials are never modified */
+        Ogre::MaterialPtr getMaterialVariant(const String& material, bool receiveShadows);
+        /** 
+         * scale LOD distances by entity scale (LOD bias) & assign rendering distance by LOD policy 
+         * (entities without 'renderingDistance')
+         */
+        void setLodRenderingDistance(Ogre::Entity* entity, const Ogre::Vector3& scale);
+        
+        /** build name & hierarchy path lookup indexes */
+        void buildNameIndex();
+        /** index scene node subtree by hierarchy path */
+        void buildPathIndex(Ogre::SceneNode* node, const String& path);
+        /** return object name without scene prefix */
+        String getLocalName(const String& name);
+        
         /** backup viewport & cameras configuration */
         void backupViewportConfiguration();
         /** restore viewport & cameras configuration */
         void restoreViewportConfiguration();
+        
+        /** return (building it if needed) triangle accelerator for a mesh */
+        DotSceneMeshBVH* getMeshBVH(const MeshPtr& mesh);
+        /** release triangle accelerators */
+        void destroyRaycastData();
+        
+        /** collect meshes, materials & textures used by scene objects */
+        void collectResources();
+        /** collect material & its textures */
+        void collectMaterial(const String& material);
+        /** return bytes used by Ogre objects created for the scene */
+        size_t getSceneObjectsMemory() const;
+        /** return bytes used by resources of a category (shared resources attributed proportionally) */
+        size_t getResourcesMemory(DotSceneResourceType type) const;
     private:
         /** datatype camera configuration */
         typedef struct 
@@ -416,6 +942,92 @@ namespace Ogre {
             CameraConfigurationType mCamera;
         } ViewportConfigurationType;
         
+        /** datatype name index entry */
+        typedef struct
+        {
+            /** Lookup key: local name or hierarchy path */
+            String mKey;
+            /** Object name */
+            DotSceneString mName;
+            /** Object type */
+            NodePropertyType mType;
+        } NameIndexEntryType;
+        /** datatype name index (sorted by key) */
+        typedef std::vector<NameIndexEntryType> NameIndexType;
+        
+        /** datatype automatic instancing mesh/material pair */
+        typedef struct
+        {
+            /** Mesh name */
+            String mMesh;
+            /** Material name (blank: first submesh material) */
+            String mMaterial;
+            /** Repetitions in scene file */
+            size_t mCount;
+            /** InstanceManager name (blank until first instance) */
+            String mManager;
+        } InstancingPairType;
+        
+        /** datatype note */
+        typedef struct
+        {
+            /** Note time */
+            Ogre::Real mTime;
+            /** Note text */
+            String mText;
+        } NoteType;
+        
+        /** datatype note track timeline */
+        typedef struct
+        {
+            /** Scene object owning track */
+            String mObject;
+            /** Track name */
+            String mName;
+            /** Entity owning track (its animation states are searched first) */
+            Ogre::Entity* mEntity;
+            /** Notes sorted by time */
+            std::vector<NoteType> mNotes;
+            /** Clock: animation state named as track (null: scene note clock) */
+            Ogre::AnimationState* mState;
+            /** Last clock time evaluated */
+            Ogre::Real mLast;
+            /** Next note (first note after mLast) */
+            size_t mCursor;
+        } NoteTrackType;
+        /** note time order */
+        static bool noteLess(const NoteType& a, const NoteType& b);
+        /** dispatch track notes from cursor to 'end' (excluded), one call by note time */
+        void dispatchNotes(NoteTrackType& track, size_t end);
+        
+        /** datatype particle system frozen while sleeping */
+        typedef struct
+        {
+            /** Particle system */
+            Ogre::ParticleSystem* mSystem;
+            /** Speed factor before sleep */
+            Ogre::Real mSpeedFactor;
+            /** Non visible update timeout before sleep */
+            Ogre::Real mTimeout;
+        } SleepParticleType;
+        /** disable per-frame work (saving its state) */
+        void suspend();
+        /** restore per-frame work saved by suspend */
+        void resume(Real fastForward);
+        
+        /** datatype skinned entity scheduled by animation LOD */
+        typedef struct
+        {
+            /** Skinned entity */
+            Ogre::Entity* mEntity;
+            /** Full rate distance */
+            Ogre::Real mDistance;
+            /** Time not applied yet to animation states */
+            Ogre::Real mElapsed;
+            /** Stagger phase (frames) */
+            unsigned long mPhase;
+        } SkeletalLodType;
+        
         /** Friend DotScenePersistenceHelper */
         friend class DotScenePersistenceHelper;
         /** Export helper class */
@@ -425,10 +1037,23 @@ namespace Ogre {
         Ogre::SceneManager* mSceneMgr;
         /** Root scene node */
         Ogre::SceneNode* mSceneRoot;
+        /** Wrapper node of <nodes> (indexed as "Nodes") */
+        Ogre::SceneNode* mNodesRoot;
         /** Default camera */
         std::map<int,String> mDefaultCameras;
         /** Backup existing viewport */
         ViewportConfigurationType* mBackupViewport[DOTSCENE_MAX_VIEWPORTS];
+        /** Shadow camera setup installed by this scene */
+        ShadowCameraSetupPtr mShadowCameraSetup;
+        
+        /** Bookkeeping arena (properties, backups, planes): released on unload */
+        DotSceneArena* mArena;
+        /** Look & track target constraints (evaluated on update) */
+        DotSceneConstraintEngine* mConstraints;
+        /** World bounds by subtree (cached while nodes don't move) */
+        DotSceneBoundsCache* mBounds;
+        /** World transforms published for other threads */
+        DotSceneTransformSnapshot* mSnapshot;
         
         /** Resource .dotscene filename */
         String mFile;
@@ -436,6 +1061,86 @@ namespace Ogre {
         String mPrefix;
         /** Flag auto create scene */
         bool mCreateSceneMode;
+        /** Flag build ray query accelerators at load */
+        bool mRaycastAtLoad;
+        /** Flag scene unloaded by manager memory budget */
+        bool mEvicted;
+        /** Flag resource group released with its last loaded scene */
+        bool mPrivateGroup;
+        /** Flag batch static entities into StaticGeometry regions */
+        bool mStaticBatching;
+        /** Static batching region size (world units) */
+        Ogre::Real mStaticRegionSize;
+        /** Flag create repeated mesh/material pairs through InstanceManager */
+        bool mInstancing;
+        /** Minimum mesh/material repetitions to use instancing */
+        size_t mInstancingThreshold;
+        /** Instancing technique */
+        Ogre::InstanceManager::InstancingTechnique mInstancingTechnique;
+        /** Instances per batch */
+        size_t mInstancingBatchSize;
+        /** Flag generate LOD levels & rendering distances */
+        bool mLodGeneration;
+        /** LOD generation policy */
+        DotSceneLodPolicy mLodPolicy;
+        /** Flag advance skeletal animations with distance based rates */
+        bool mAnimationLod;
+        /** Skeletal animation full rate distance */
+        Ogre::Real mAnimationLodDistance;
+        /** Max frames between skeletal animation updates */
+        int mAnimationLodInterval;
+        /** Skinned entities scheduled by animation LOD */
+        std::vector<SkeletalLodType> mSkeletalLods;
+        /** Skinned entities due this frame (indexes) */
+        std::vector<size_t> mSkeletalDue;
+        /** Frames updated (animation LOD stagger) */
+        unsigned long mFrame;
+        /** Last update time (microseconds) */
+        unsigned long mUpdateTime;
+        /** Note tracks */
+        std::vector<NoteTrackType> mNoteTracks;
+        /** Note clock (tracks not bound to animation states) */
+        Ogre::Real mNoteTime;
+        /** Note track listeners */
+        std::vector<NoteListener*> mNoteListeners;
+        /** Layers flags by name (undeclared layers bits allocated by manager) */
+        std::map<String, Ogre::uint32> mLayers;
+        /** Layers flags hidden by this scene */
+        Ogre::uint32 mHiddenLayers;
+        /** Flag scene sleeping */
+        bool mSleeping;
+        /** Visibility before sleep */
+        bool mSleepVisible;
+        /** Root timer when scene fell asleep (milliseconds) */
+        unsigned long mSleepStart;
+        /** Animation states disabled by sleep */
+        std::vector<Ogre::AnimationState*> mSleepAnimations;
+        /** Particle systems frozen by sleep */
+        std::vector<SleepParticleType> mSleepParticles;
+        /** Render targets auto updated before sleep */
+        std::vector<Ogre::RenderTarget*> mSleepTargets;
+        /** Scene nodes by handle index */
+        std::vector<Ogre::SceneNode*> mHandleNodes;
+        /** Handle index by scene node */
+        std::map<const Ogre::Node*, Ogre::uint32> mHandleIndex;
+        /** Load generation (stamped in handles) */
+        Ogre::uint32 mHandleGeneration;
+        /** Flag apply viewports, cameras & environment (false when reloading evicted scene) */
+        bool mApplyGlobalState;
+        /** Flag apply global state on first load (scene option) */
+        bool mGlobalState;
+        /** Flag keep parsed document while loaded */
+        bool mKeepDocument;
+        /** Flag parsed document acquired from manager (released on unload) */
+        bool mDocumentAcquired;
+        /** Scene root node transform */
+        Ogre::Vector3 mRootPosition;
+        /** Scene root node transform */
+        Ogre::Quaternion mRootOrientation;
+        /** Scene root node transform */
+        Ogre::Vector3 mRootScale;
+        /** Creation options */
+        Ogre::NameValuePairList mOptions;
         /** Version of .dotscene file */
         String mVersion;
         /** Units conversion factor */
@@ -459,29 +1164,66 @@ namespace Ogre {
         PropertyList mProperties;
         
         /** Objects in scene:  scenenodes*/
-        StringVector mSceneNodes;
+        DotSceneStringVector mSceneNodes;
         /** Objects in scene: dynamic entities */
-        StringVector mDynamicEntities;
+        DotSceneStringVector mDynamicEntities;
         /** Objects in scene: static entities */
-        StringVector mStaticEntities;
+        DotSceneStringVector mStaticEntities;
         /** Objects in scene: lights */
-        StringVector mLights;
+        DotSceneStringVector mLights;
         /** Objects in scene: cameras */
-        StringVector mCameras;
+        DotSceneStringVector mCameras;
         /** Objects in scene: billboards set */
-        StringVector mBillboardSets;
+        DotSceneStringVector mBillboardSets;
         /** Objects in scene: particles system */
-        StringVector mParticleSystem;
+        DotSceneStringVector mParticleSystem;
+        /** Objects in scene: particles system templates */
+        DotSceneStringVector mParticleTemplates;
         /** Objects in scene: External resources */ 
         StringMap mExternals;
         /** Objects in scene: Mesh & manual objects  */ 
-        StringVector mMeshes;
+        DotSceneStringVector mMeshes;
         
         /** Objects in scene: RenderTextures */
-        StringVector mRenderTextures;
+        DotSceneStringVector mRenderTextures;
+        /** Objects in scene: InstanceManagers */
+        DotSceneStringVector mInstanceManagers;
+        /** Objects in scene: instanced entities by scene name */
+        std::map<DotSceneString, Ogre::InstancedEntity*> mInstancedEntities;
+        /** Objects in scene: scene names of instanced entities */
+        std::map<const Ogre::MovableObject*, DotSceneString> mInstancedNames;
+        /** Automatic instancing pairs ("mesh|material") */
+        std::map<String, InstancingPairType> mInstancingPairs;
+        /** Prefab definitions by name (valid while loading) */
+        std::map<String, TiXmlElement*> mPrefabs;
+        /** Prefabs being instantiated (recursive references) */
+        std::set<String> mActivePrefabs;
+        /** Objects in scene: StaticGeometry */
+        DotSceneStringVector mStaticGeometries;
+        /** Objects in scene: InstancedGeometry */
+        DotSceneStringVector mInstancedGeometries;
+        /** Static & instanced geometries declared not visible */
+        std::set<DotSceneString> mHiddenGeometries;
+        /** Objects in scene: entities rendered by static batches (sorted after build) */
+        std::vector<Ogre::Entity*> mBatchedEntities;
+        /** Node animations (animation & state share name) */
+        std::vector<Ogre::AnimationState*> mAnimationStates;
+        /** Objects in scene: MovablePlanes (owned by arena) */
+        std::vector<MovablePlane*> mMovablePlanes;
         
         /** Objects in scene: TODO */
-        std::vector<String> mUserReferences;
+        DotSceneStringVector mUserReferences;
+        
+        /** Lookup index: objects by local name */
+        NameIndexType mNameIndex;
+        /** Lookup index: objects by hierarchy path */
+        NameIndexType mPathIndex;
+        
+        /** Ray query accelerators (shared by all entities using the same mesh) */
+        std::map<String, DotSceneMeshBVH*> mMeshBVHs;
+        
+        /** Resources used by scene objects (by category) */
+        DotSceneResourceSet mResources[RESOURCE_TYPE_COUNT];
     }; //Class DotScene
     
     /****************************************************************************/
@@ -505,6 +1247,20 @@ namespace Ogre {
     class _DotSceneManagerExport DotSceneManager : public Ogre::ResourceManager, 
                                                    public Ogre::Singleton<DotSceneManager>
     {
+    public:
+        /** Listener: memory budget events */
+        class _DotSceneManagerExport Listener
+        {
+        public:
+            virtual ~Listener() {}
+            /** scene is going to be evicted: return false to keep it loaded */
+            virtual bool sceneEvicting(DotScene* scene) { return true; }
+            /** scene has been evicted: unloaded but registered (reloaded on next access) */
+            virtual void sceneEvicted(DotScene* scene) {}
+            /** evicted scene has been reloaded */
+            virtual void sceneReloaded(DotScene* scene) {}
+        }; //Class Listener
+        
     public:
         /** Constructor */
         DotSceneManager();
@@ -520,8 +1276,25 @@ namespace Ogre {
                                 const String& namePrefix=StringUtil::BLANK,
                                 const String& groupName=Ogre::ResourceGroupManager::AUTODETECT_RESOURCE_GROUP_NAME,
                                 const Ogre::SceneManager* sceneManager=0,
-                                bool visible=true
+                                bool visible=true,
+                                const Ogre::NameValuePairList* options=0
                                );
+        /** 
+         * Instantiate an already loaded scene: reuses its parsed document (never reparsed while 
+         * any instance is loaded), its options and its meshes & materials
+         * @param source scene to instantiate
+         * @param name new scene name
+         * @param namePrefix prefix for all objects of the instance (must be unique)
+         * @param position, orientation, scale instance root node transform
+         */
+        DotScenePtr instantiateScene(const DotScenePtr& source,
+                                     const String& name, 
+                                     const String& namePrefix,
+                                     const Ogre::Vector3& position=Ogre::Vector3::ZERO,
+                                     const Ogre::Quaternion& orientation=Ogre::Quaternion::IDENTITY,
+                                     const Ogre::Vector3& scale=Ogre::Vector3::UNIT_SCALE,
+                                     bool visible=true
+                                    );
         /** Create scene from file */
         void destroyScene(const String& name);
         /** Create scene from file */
@@ -529,9 +1302,77 @@ namespace Ogre {
         /** Destroy all scenes */
         void destroyAllScenes();
         
-        /** Return DotScene by name */
+        /** Return DotScene by name (reloads evicted scene) */
         const DotScenePtr getScene(const String& name=StringUtil::BLANK);
         
+        /** add memory budget listener */
+        void addListener(Listener* listener);
+        /** remove memory budget listener */
+        void removeListener(Listener* listener);
+        
+        /** pinned scenes are never evicted */
+        void pinScene(const String& name);
+        /** allow scene eviction */
+        void unpinScene(const String& name);
+        /** return true if scene is pinned */
+        bool isScenePinned(const String& name) const;
+        
+        /** 
+         * unload least recently visible hidden scenes until memory usage fits budget 
+         * (ResourceManager::setMemoryBudget), called on scene creation & visibility changes
+         * @return number of scenes evicted
+         */
+        size_t enforceMemoryBudget();
+        
+        /** 
+         * update all loaded scenes: behaviours solved on worker threads, then written 
+         * to Ogre objects on calling thread (time by scene: DotScene::getLastUpdateTime)
+         */
+        void updateAll(Ogre::Real delta);
+        /** set worker threads used by updateAll (0: calling thread only) */
+        void setUpdateThreadCount(size_t threads);
+        /** return worker threads used by updateAll */
+        size_t getUpdateThreadCount() const;
+        
+        /** return memory usage of loaded scenes by category (shared resources counted once) */
+        DotSceneMemoryBreakdown getMemoryBreakdown();
+        /** return number of loaded scenes using a resource */
+        size_t getResourceUsers(DotSceneResourceType type, const String& name) const;
+        /** return number of loaded scenes using a private resource group */
+        size_t getResourceGroupUsers(const String& group) const;
+        
+        /** 
+         * enable disk cache for meshes with derived data built at load (tangents, edge lists),
+         * keyed by mesh name & content hash (blank directory disables cache)
+         */
+        void setMeshCacheDirectory(const String& directory);
+        /** return mesh cache directory (blank if disabled) */
+        const String& getMeshCacheDirectory() const;
+        /** internal method: return cache file name for a mesh (blank if cache disabled or mesh not found) */
+        const String& _getMeshCacheName(const String& mesh, const String& group);
+        
+        /** internal method: scene has collected its resources (load) */
+        void _notifyResourcesUsed(DotScene* scene);
+        /** internal method: scene is going to release its resources (unload) */
+        void _notifyResourcesReleased(DotScene* scene);
+        /** internal method: scene visibility has changed */
+        void _notifySceneVisibility(DotScene* scene, bool visible);
+        /** internal method: evicted scene has been reloaded */
+        void _notifySceneReloaded(DotScene* scene);
+        /** 
+         * internal method: return flags of a layer shared by all scenes (viewport masks are shared);
+         * flags 0 allocates a free bit (highest first) to undeclared layer, 0 if none is free
+         */
+        Ogre::uint32 _registerLayer(const String& name, Ogre::uint32 flags);
+        /** internal method: a scene hides/shows layer flags (bits hidden while any scene hides them) */
+        void _setLayersHidden(Ogre::uint32 flags, bool hidden);
+        /** internal method: return flags hidden in viewports */
+        Ogre::uint32 _getHiddenLayers() const;
+        /** internal method: return parsed .scene document (cached while used) or null on error */
+        TiXmlDocument* _acquireDocument(const String& file, const String& group);
+        /** internal method: scene no longer uses a parsed document */
+        void _releaseDocument(const String& file, const String& group);
+        
         /** Singleton pattern */
         static DotSceneManager& getSingleton();
         /** Singleton pattern */
@@ -544,12 +1385,67 @@ namespace Ogre {
                                    Ogre::ManualResourceLoader *loader, 
                                    const Ogre::NameValuePairList *createParams);
     private:
+        /** datatype scene budget state */
+        typedef struct
+        {
+            /** Visibility clock when scene was last visible */
+            unsigned long mLastVisible;
+            /** Flag never evict */
+            bool mPinned;
+        } SceneStateType;
+        
+        /** datatype parsed .scene document */
+        typedef struct
+        {
+            /** Parsed document */
+            TiXmlDocument* mDocument;
+            /** Scenes using document */
+            size_t mUsers;
+        } DocumentType;
+        
+        /** release resources (by category) no longer used by any scene */
+        void releaseResources(const std::vector<DotSceneString>* resources);
+        /** release unreferenced resources of a private group */
+        void releaseResourceGroup(const String& group);
+        
         /** event emitter name */
         static const String msName;
         /** current scene active */
         StringVector mScenes;
         /** create scene */
         String mCurrentScene;
+        
+        /** Loaded scenes using each resource (by category) */
+        std::map<DotSceneString, size_t> mResourceUsers[RESOURCE_TYPE_COUNT];
+        /** Loaded scenes using each private resource group */
+        std::map<String, size_t> mGroupUsers;
+        
+        /** Budget state by scene name */
+        std::map<String, SceneStateType> mSceneStates;
+        /** Visibility clock (increased on every visibility change) */
+        unsigned long mVisibilityClock;
+        /** Flag enforcing budget (evictions don't trigger nested enforcement) */
+        bool mEnforcingBudget;
+        /** Memory usage by loaded scene (computed at load: budget checks don't walk resources) */
+        std::map<String, size_t> mSceneSizes;
+        /** Memory budget listeners */
+        std::vector<Listener*> mListeners;
+        /** Parsed .scene documents by group & file */
+        std::map<String, DocumentType> mDocuments;
+        /** Mesh cache directory */
+        String mMeshCacheDirectory;
+        /** Mesh cache file names by group & mesh (content hashed once) */
+        std::map<String, String> mMeshCacheNames;
+        /** Update worker threads (created on first parallel update) */
+        DotSceneUpdatePool* mUpdatePool;
+        /** Update worker threads count */
+        size_t mUpdateThreads;
+        /** Layers flags by name (all scenes) */
+        std::map<String, Ogre::uint32> mLayers;
+        /** Scenes hiding each visibility bit */
+        size_t mHiddenLayerUsers[32];
+        /** Flags hidden in viewports */
+        Ogre::uint32 mHiddenLayers;
     }; //Class DotSceneManager
 }//namespace P4H
 
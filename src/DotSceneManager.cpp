@@ -29,15 +29,35 @@
 #include <OgreShadowCameraSetupLiSPSM.h>
 #include <OgreShadowCameraSetupPlaneOptimal.h>
 #include <OgreShadowCameraSetupPSSM.h>
+#include <OgreAtomicWrappers.h>
+#include <OgreMeshSerializer.h>
+#include <OgreProgressiveMesh.h>
 
 #include <boost/algorithm/string.hpp>
 #include <boost/algorithm/string/predicate.hpp>
-#include <boost/uuid/uuid.hpp>
-#include <boost/uuid/uuid_io.hpp>
-#include <boost/uuid/uuid_generators.hpp>
+#include <boost/unordered_set.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/bind.hpp>
 
 #include <tinyxml.h>
 
+#if defined(__SSE__) || defined(_M_IX86_FP) || defined(_M_X64)
+    #include <xmmintrin.h>
+    #define DOTSCENE_USE_SSE            1
+#else
+    #define DOTSCENE_USE_SSE            0
+#endif
+
+#if defined(_MSC_VER)
+    #include <intrin.h>
+    #define DOTSCENE_MEMORY_BARRIER()   _ReadWriteBarrier(); _mm_mfence()
+#else
+    #define DOTSCENE_MEMORY_BARRIER()   __sync_synchronize()
+#endif
+
 #include "DotSceneManager.h"
 
 #define CREATE_SCENE_MODE_AUTO          "auto"
@@ -59,6 +79,31 @@
 #define ANIMATION_PKG_MAYA              0
 #define ANIMATION_PKG_OTHER             1
 
+#define BVH_MAX_LEAF_TRIANGLES          4
+#define BVH_MAX_DEPTH                   64
+#define BVH_RAY_PACKET_SIZE             4
+
+#define STATIC_BATCH_REGION_SIZE        1000
+
+#define INSTANCING_THRESHOLD            32
+#define INSTANCING_BATCH_SIZE           80
+#define INSTANCING_MATERIAL_SUFFIX      "/Instanced"
+
+#define ANIMATION_LOD_DISTANCE          50
+#define ANIMATION_LOD_INTERVAL          8
+
+#define SLEEP_FAST_FORWARD_INTERVAL     0.1
+
+#define HANDLE_INDEX_BITS               24
+#define HANDLE_INDEX_MASK               0x00FFFFFF
+
+#define SNAPSHOT_READ_RETRIES           8
+
+#define MESH_CACHE_GROUP                "DotSceneMeshCache"
+
+#define ARENA_BLOCK_SIZE                65536
+#define ARENA_ALIGNMENT                 16
+
 using namespace Ogre;
 
 /*****************************************************************************/
@@ -66,14 +111,16 @@ using namespace Ogre;
 /*****************************************************************************/
 static void log(const String& formatString, ...);
 //----------------------------------------------------------------------------
-static String generateUUID(const String& prefix=StringUtil::BLANK, const String& suffix=StringUtil::BLANK);
-//----------------------------------------------------------------------------
 static bool isPowerOfTwo(int value);
 //----------------------------------------------------------------------------
 static unsigned int nextSmallestPowerOfTwo(unsigned int value);
 //----------------------------------------------------------------------------
 static unsigned int nextLargestPowerOfTwo(unsigned int value);
 //----------------------------------------------------------------------------
+static uint64 hashStream(DataStreamPtr& stream);
+//----------------------------------------------------------------------------
+static void getWorldTransform(const Node* node, Vector3& position, Quaternion& orientation, Vector3& scale);
+//----------------------------------------------------------------------------
 inline String stringify(double x);
 //----------------------------------------------------------------------------
 inline String stringify(int x);
@@ -101,6 +148,11 @@ public:
     /** persists scene */
     bool persist(const String& filename=StringUtil::BLANK);
 private:
+    /** write current transform of prefab instances ('prefab' definitions are kept as authored) */
+    void persistInstances(TiXmlElement* node);
+    /** replace node transform elements by scene node transform */
+    void persistTransform(TiXmlElement* node, SceneNode* sceneNode);
+    
 //     /** dotscene loader method: process 'scene' node*/
 //     void persistScene(TiXmlElement* XMLRoot);
 //     /** dotscene loader method: process 'nodes' node*/
@@ -177,6 +229,449 @@ private:
     DotScene* mScene;
 }; //DotScenePersistenceHelper
 
+/*****************************************************************************/
+/** DotSceneStringEntry (declaration)                                        */                   
+/*****************************************************************************/
+/** Pooled string: shared by all DotSceneString handles with the same text */
+class DotSceneStringEntry
+{
+public:
+    /** Constructor */
+    DotSceneStringEntry(const String& str):mString(str), mRefs(0) {}
+    
+    /** Pooled string */
+    String mString;
+    /** Handles referencing this string */
+    mutable AtomicScalar<uint32> mRefs;
+}; //DotSceneStringEntry
+
+/** Functor: hash pooled strings (and lookup keys) */
+struct DotSceneStringHash
+{
+    size_t operator()(const DotSceneStringEntry& entry) const { return boost::hash<String>()(entry.mString); }
+    size_t operator()(const String& str) const { return boost::hash<String>()(str); }
+};
+/** Functor: compare pooled strings (and lookup keys) */
+struct DotSceneStringEqual
+{
+    bool operator()(const DotSceneStringEntry& a, const DotSceneStringEntry& b) const { return a.mString == b.mString; }
+    bool operator()(const String& a, const DotSceneStringEntry& b) const { return a == b.mString; }
+    bool operator()(const DotSceneStringEntry& a, const String& b) const { return a.mString == b; }
+};
+
+/** String pool (node based: entries never move) */
+class DotSceneStringPool
+{
+public:
+    /** Constructor */
+    DotSceneStringPool():mMemory(0) {}
+    
+    /** return pooled entry (inserted if needed) with one more reference */
+    const DotSceneStringEntry* acquire(const String& str);
+    /** return pooled entry with one more reference or null (never inserts) */
+    const DotSceneStringEntry* find(const String& str);
+    /** return pooled entry or null, no reference taken (never inserts) */
+    const DotSceneStringEntry* lookup(const String& str);
+    /** add one reference */
+    void addRef(const DotSceneStringEntry* entry);
+    /** drop one reference (entry is erased with last reference) */
+    void release(const DotSceneStringEntry* entry);
+    
+    /** return empty string entry: static, not pooled nor counted */
+    static const DotSceneStringEntry* blank() { return &msBlank; }
+    
+    /** return number of pooled strings */
+    size_t size();
+    /** return bytes used by pooled strings */
+    size_t memory();
+    
+    /** Singleton (created on first use) */
+    static DotSceneStringPool& getSingleton();
+private:
+    /** datatype pool */
+    typedef boost::unordered_set<DotSceneStringEntry, DotSceneStringHash, DotSceneStringEqual> PoolType;
+    
+    /** return bytes used by an entry */
+    static size_t entryMemory(const DotSceneStringEntry& entry);
+    
+    /** Lock (acquire/find & last release) */
+    boost::mutex mMutex;
+    /** Pooled strings */
+    PoolType mPool;
+    /** Bytes used by pooled strings */
+    size_t mMemory;
+    /** Empty string entry */
+    static const DotSceneStringEntry msBlank;
+}; //DotSceneStringPool
+
+/*****************************************************************************/
+/** DotSceneArena (declaration)                                              */                   
+/*****************************************************************************/
+/** Monotonic arena: blocks are kept on release so load/unload cycles stop allocating */
+class DotSceneArena
+{
+public:
+    /** Constructor */
+    DotSceneArena(size_t blockSize=ARENA_BLOCK_SIZE);
+    /** Destructor: release objects & return blocks to the system */
+    ~DotSceneArena();
+    
+    /** allocate raw memory (ARENA_ALIGNMENT aligned) */
+    void* allocate(size_t size);
+    
+    /** create object in arena (destroyed on release) */
+    template<typename T>
+    T* create() { return track(new (allocate(sizeof(T))) T()); }
+    /** register object constructed in arena memory (destroyed on release) */
+    template<typename T>
+    T* track(T* object) 
+    { 
+        mObjects.push_back(std::make_pair(static_cast<void*>(object), &DotSceneArena::destroy<T>)); 
+        return object;
+    }
+    
+    /** destroy all objects in one operation (blocks are kept for next load) */
+    void release();
+    
+    /** return allocation counters */
+    const DotSceneAllocationStats& getStats() const;
+private:
+    /** destructor thunk */
+    template<typename T>
+    static void destroy(void* object) { static_cast<T*>(object)->~T(); }
+    
+    /** datatype memory block */
+    typedef struct
+    {
+        unsigned char* mData;
+        size_t mSize, mOffset;
+    } BlockType;
+    
+    /** Block size */
+    size_t mBlockSize;
+    /** Blocks (first reused blocks, then oversized blocks) */
+    std::vector<BlockType> mBlocks;
+    /** Current block */
+    size_t mCurrent;
+    /** Objects with destructor (construction order) */
+    std::vector<std::pair<void*, void (*)(void*)> > mObjects;
+    /** Allocation counters */
+    DotSceneAllocationStats mStats;
+}; //DotSceneArena
+
+/*****************************************************************************/
+/** DotSceneMeshBVH (declaration)                                            */                   
+/*****************************************************************************/
+/** Triangle bounding volume hierarchy (mesh local space) used by ray queries */
+class DotSceneMeshBVH
+{
+public:
+    /** Constructor: read triangles from mesh buffers and build hierarchy */
+    DotSceneMeshBVH(const MeshPtr& mesh);
+    
+    /** 
+     * intersect a packet of up to BVH_RAY_PACKET_SIZE rays (mesh local space) 
+     * distance[i] is input (max distance) and output (closest hit)
+     * @return mask of rays with a closer hit
+     */
+    int intersect(const Ray* rays, size_t count, Real* distance, 
+                  unsigned int* subMesh, unsigned int* triangle) const;
+    
+    /** @return memory used by the hierarchy (in bytes) */
+    size_t getMemoryUsage() const;
+private:
+    /** datatype hierarchy node (leaf if mCount > 0, left child follows the node) */
+    typedef struct
+    {
+        float mMin[3], mMax[3];
+        uint32 mStart, mCount, mRight;
+    } NodeType;
+    
+    /** datatype ray packet (structure of arrays) */
+    typedef struct
+    {
+        float mOrigin[3][BVH_RAY_PACKET_SIZE];
+        float mInvDirection[3][BVH_RAY_PACKET_SIZE];
+        float mDistance[BVH_RAY_PACKET_SIZE];
+        int mActive;
+    } RayPacketType;
+    
+    /** build hierarchy for triangles [start, start+count) */
+    uint32 build(uint32 start, uint32 count, int depth);
+    /** @return mask of rays of the packet that cross node bounds */
+    int intersectBounds(const NodeType& node, const RayPacketType& packet) const;
+    /** intersect triangle (Moller-Trumbore) @return distance or -1 */
+    Real intersectTriangle(uint32 triangle, const Ray& ray) const;
+    
+    /** Hierarchy nodes */
+    std::vector<NodeType> mNodes;
+    /** Triangles: vertex 0, edge 1 & edge 2 (9 floats by triangle) */
+    std::vector<float> mTriangles;
+    /** Triangles: centroids (build only) */
+    std::vector<Vector3> mCentroids;
+    /** Triangles: build order */
+    std::vector<uint32> mOrder;
+    /** Triangles: submesh index */
+    std::vector<uint32> mSubMesh;
+    /** Triangles: index inside the submesh */
+    std::vector<uint32> mIndex;
+}; //DotSceneMeshBVH
+
+/*****************************************************************************/
+/** DotSceneConstraintEngine (declaration)                                   */                   
+/*****************************************************************************/
+/** 
+ * Look & track target constraints (structure of arrays): nodes orient its local direction 
+ * to a target node (plus offset in target space), evaluated by dependency level
+ */
+class DotSceneConstraintEngine
+{
+public:
+    /** Constructor */
+    DotSceneConstraintEngine();
+    
+    /** 
+     * add constraint (target resolved on build: scene prefixed name first) 
+     * @param node constrained node
+     * @param target target node name
+     * @param fallback target node name if 'target' doesn't exist
+     */
+    void add(SceneNode* node, const String& target, const String& fallback, 
+             const Vector3& localDirection, const Vector3& offset);
+    /** resolve targets & sort constraints by dependency level */
+    void build(SceneManager* sceneMgr);
+    /** remove all constraints */
+    void clear();
+    
+    /** evaluate constraints @return number of nodes written (changed) */
+    size_t update();
+    /** solve constraints without writing nodes (only reads scene nodes: thread safe) */
+    void prepare();
+    /** write nodes changed by last prepare() @return number of nodes written */
+    size_t apply();
+    
+    /** @return number of constraints */
+    size_t getCount() const;
+    /** @return memory used (in bytes) */
+    size_t getMemoryUsage() const;
+private:
+    /** datatype constraint waiting for build */
+    typedef struct
+    {
+        SceneNode* mNode;
+        String mTarget;
+        String mFallback;
+        Vector3 mLocalDirection;
+        Vector3 mOffset;
+    } PendingType;
+    
+    /** dependency level of constraint (memoized, -1 while evaluating) */
+    int getLevel(size_t pending, const std::map<const Node*, size_t>& owners, 
+                 const std::vector<SceneNode*>& targets, std::vector<int>& levels) const;
+    /** world transform from local transforms, orientations solved by previous levels override nodes */
+    void getSolvedWorldTransform(const Node* node, Vector3& position, Quaternion& orientation, Vector3& scale) const;
+    /** gather world transforms of lanes [begin, end) */
+    void gather(size_t begin, size_t end);
+    /** solve lane (scalar) */
+    void solve(size_t i);
+    /** solve lanes [i, i+4) */
+    void solve4(size_t i);
+    
+    /** Constraints waiting for build */
+    std::vector<PendingType> mPending;
+    /** Level start lanes (levels padded to multiple of 4 lanes), last item is lane count */
+    std::vector<size_t> mLevels;
+    
+    /** Lanes: constrained node (null on padding) */
+    std::vector<SceneNode*> mNodes;
+    /** Lanes: target node */
+    std::vector<SceneNode*> mTargets;
+    /** Lane by constrained node (only with several levels) */
+    std::map<const Node*, size_t> mLanes;
+    /** Lanes: constants (local direction normalised, offset in target space) */
+    std::vector<float> mDirection[3], mOffset[3];
+    /** Lanes: node & target world positions (gathered) */
+    std::vector<float> mPosition[3], mTarget[3];
+    /** Lanes: node & parent world orientations w,x,y,z (gathered) */
+    std::vector<float> mOrientation[4], mParent[4];
+    /** Lanes: new local orientation w,x,y,z & changed flag (solved) */
+    std::vector<float> mResult[4];
+    std::vector<int> mChanged;
+}; //DotSceneConstraintEngine
+
+/*****************************************************************************/
+/** DotSceneUpdatePool (declaration)                                         */                   
+/*****************************************************************************/
+/** Worker threads running first update phase of scenes (DotSceneManager::updateAll) */
+class DotSceneUpdatePool
+{
+public:
+    /** Constructor @param threads worker threads (calling thread also works) */
+    DotSceneUpdatePool(size_t threads);
+    /** Destructor: joins workers */
+    ~DotSceneUpdatePool();
+    
+    /** run DotScene::_prepareUpdate of all scenes, return when all are done */
+    void run(const std::vector<DotScene*>& scenes, Real delta);
+    /** @return number of worker threads */
+    size_t getThreadCount() const;
+private:
+    /** worker thread loop */
+    void worker();
+    /** run jobs until none left */
+    void drain();
+    
+    /** Worker threads */
+    boost::thread_group mThreads;
+    /** Protects jobs state */
+    boost::mutex mMutex;
+    /** Signals new jobs (or quit) */
+    boost::condition_variable mWake;
+    /** Signals all jobs done */
+    boost::condition_variable mDone;
+    /** Jobs: scenes to prepare */
+    const std::vector<DotScene*>* mScenes;
+    /** Jobs: update delta */
+    Real mDelta;
+    /** Next job */
+    size_t mNext;
+    /** Jobs not finished */
+    size_t mPending;
+    /** Job batch number (wakes workers) */
+    unsigned long mGeneration;
+    /** Flag stop workers */
+    bool mQuit;
+}; //DotSceneUpdatePool
+
+/*****************************************************************************/
+/** DotSceneBoundsCache (declaration)                                        */                   
+/*****************************************************************************/
+/** World bounds by subtree: cached until a node of subtree moves (node listener) */
+class DotSceneBoundsCache : public Node::Listener
+{
+public:
+    /** Constructor (scene is notified of destroyed nodes) */
+    DotSceneBoundsCache(DotScene* scene);
+    /** Destructor */
+    virtual ~DotSceneBoundsCache();
+    
+    /** 
+     * listen nodes of subtree not listened yet: new nodes invalidate their ancestors, nodes with 
+     * application listener (and their ancestors) are computed, not cached
+     * @return true if whole subtree is listened
+     */
+    bool track(SceneNode* root);
+    /** stop listening all nodes */
+    void clear();
+    
+    /** @return world bounds of subtree (objects & children) */
+    const AxisAlignedBox& getBounds(SceneNode* node);
+    /** mark node & its ancestors dirty */
+    void invalidate(const Node* node);
+    
+    /** @return memory used (in bytes) */
+    size_t getMemoryUsage() const;
+    
+    /** Node::Listener: derived transform changed */
+    virtual void nodeUpdated(const Node* node);
+    /** Node::Listener: node destroyed */
+    virtual void nodeDestroyed(const Node* node);
+    /** Node::Listener: node attached to a parent */
+    virtual void nodeAttached(const Node* node);
+    /** Node::Listener: node detached from its parent */
+    virtual void nodeDetached(const Node* node);
+private:
+    /** datatype cached subtree bounds */
+    typedef struct
+    {
+        /** World bounds of subtree */
+        AxisAlignedBox mBounds;
+        /** Parent when cached (detach notifications come without parent) */
+        const Node* mParent;
+        /** Flag bounds must be computed (ancestors of dirty nodes are dirty) */
+        bool mDirty;
+        /** Flag subtree has nodes not listened: always computed */
+        bool mVolatile;
+    } EntryType;
+    
+    /** compute bounds of subtree (cached children are reused) */
+    AxisAlignedBox computeBounds(SceneNode* node);
+    
+    /** Cached bounds by node */
+    std::map<const Node*, EntryType> mEntries;
+    /** Bounds of nodes not cached */
+    AxisAlignedBox mUncached;
+    /** Scene owning nodes */
+    DotScene* mScene;
+}; //DotSceneBoundsCache
+
+/*****************************************************************************/
+/** DotSceneTransformSnapshot (declaration)                                  */                   
+/*****************************************************************************/
+/** 
+ * World transforms of nodes published once per frame into two SoA buffers: 
+ * readers copy front buffer while next frame is written in back one (seqlock by buffer)
+ */
+class DotSceneTransformSnapshot : public SceneManager::Listener
+{
+public:
+    /** Constructor */
+    DotSceneTransformSnapshot();
+    /** Destructor */
+    virtual ~DotSceneTransformSnapshot();
+    
+    /** 
+     * publish nodes (null: stale handle) after each scene graph update of sceneMgr,
+     * keys are handle indices of nodes (HANDLE_INDEX_MASK: stale handle)
+     */
+    void setNodes(SceneManager* sceneMgr, const std::vector<SceneNode*>& nodes, const std::vector<uint32>& keys);
+    /** stop publishing (readers keep last snapshot) */
+    void clear();
+    /** node of handle index destroyed: its slots keep last published transform */
+    void removeNode(uint32 key);
+    
+    /** copy derived transforms to back buffer & flip (main thread) */
+    void publish(unsigned long frame);
+    /** copy front buffer (any thread) */
+    bool read(std::vector<Vector3>& positions, std::vector<Quaternion>& orientations, unsigned long* frame) const;
+    /** @return frame of front buffer (any thread) */
+    unsigned long getFrame() const;
+    
+    /** @return memory used (in bytes) */
+    size_t getMemoryUsage() const;
+    
+    /** SceneManager::Listener: derived transforms are up to date */
+    virtual void postUpdateSceneGraph(SceneManager* source, Camera* camera);
+private:
+    /** datatype snapshot buffer (structure of arrays) */
+    typedef struct
+    {
+        /** Positions */
+        std::vector<Real> mX, mY, mZ;
+        /** Orientations */
+        std::vector<Real> mQw, mQx, mQy, mQz;
+    } BufferType;
+    
+    /** Scene manager listened */
+    SceneManager* mSceneMgr;
+    /** Nodes published */
+    std::vector<SceneNode*> mNodes;
+    /** First slot by handle index (mNodes size: none) */
+    std::vector<size_t> mFirstSlots;
+    /** Next slot of same handle index by slot (mNodes size: none) */
+    std::vector<size_t> mNextSlots;
+    /** Buffers: front is read, back is written */
+    BufferType mBuffers[2];
+    /** Sequence by buffer (odd while written) */
+    volatile unsigned long mSequence[2];
+    /** Frame by buffer */
+    volatile unsigned long mFrames[2];
+    /** Front buffer */
+    volatile int mFront;
+    /** Nodes by buffer */
+    volatile size_t mSize;
+}; //DotSceneTransformSnapshot
+
 /*****************************************************************************/
 /** DotScene                                                                 */                   
 /*****************************************************************************/
@@ -188,11 +683,45 @@ DotScene::DotScene(ResourceManager* creator,
                    bool isManual, 
                    ManualResourceLoader* loader)
          :Resource(creator, name, handle, group, isManual, loader),
+          helper(0),
           mSceneMgr(0), 
           mSceneRoot(0),
+          mNodesRoot(0),
+          mArena(new DotSceneArena()),
+          mConstraints(new DotSceneConstraintEngine()),
+          mBounds(new DotSceneBoundsCache(this)),
+          mSnapshot(new DotSceneTransformSnapshot()),
           mFile(StringUtil::BLANK), 
           mPrefix(StringUtil::BLANK),
           mCreateSceneMode(true), 
+          mRaycastAtLoad(false),
+          mEvicted(false),
+          mPrivateGroup(false),
+          mStaticBatching(false),
+          mStaticRegionSize(STATIC_BATCH_REGION_SIZE),
+          mInstancing(false),
+          mInstancingThreshold(INSTANCING_THRESHOLD),
+          mInstancingTechnique(InstanceManager::HWInstancingBasic),
+          mInstancingBatchSize(INSTANCING_BATCH_SIZE),
+          mLodGeneration(false),
+          mAnimationLod(false),
+          mAnimationLodDistance(ANIMATION_LOD_DISTANCE),
+          mAnimationLodInterval(ANIMATION_LOD_INTERVAL),
+          mFrame(0),
+          mUpdateTime(0),
+          mNoteTime(0),
+          mHiddenLayers(0),
+          mSleeping(false),
+          mSleepVisible(false),
+          mSleepStart(0),
+          mHandleGeneration(0),
+          mApplyGlobalState(true),
+          mGlobalState(true),
+          mKeepDocument(false),
+          mDocumentAcquired(false),
+          mRootPosition(Vector3::ZERO),
+          mRootOrientation(Quaternion::IDENTITY),
+          mRootScale(Vector3::UNIT_SCALE),
           mVersion(StringUtil::BLANK),
           mAmbientLight(ColourValue::White),
           mBackgroundColor(ColourValue::Black)
@@ -204,7 +733,21 @@ DotScene::DotScene(ResourceManager* creator,
     assert(params->end() != params->find("prefix"));
     assert(params->end() != params->find("sceneManager"));
     assert(params->end() != params->find("createSceneMode"));
- 
+    
+    mOptions = *params;
+    
+    //LOD policy preset first: options may override its values
+    NameValuePairList::const_iterator it_quality = params->find(DOTSCENE_OPTION_LOD_QUALITY);
+    if (params->end() != it_quality)
+    {
+        String quality = it_quality->second;
+        StringUtil::toLowerCase(quality);
+        if ("low" == quality) mLodPolicy = DotSceneLodPolicy(3, 0.6f, 5.0f, 50.0f);
+        else if ("medium" == quality) mLodPolicy = DotSceneLodPolicy(3, 0.5f, 10.0f, 100.0f);
+        else if ("high" == quality) mLodPolicy = DotSceneLodPolicy(2, 0.35f, 20.0f, 200.0f);
+        else log("Error: Invalid LOD quality " + it_quality->second);
+    }
+    
     for(NameValuePairList::const_iterator it=params->begin(); it!=params->end();it++)
     {
         if ("file" == it->first)
@@ -215,6 +758,56 @@ DotScene::DotScene(ResourceManager* creator,
             mSceneMgr = Root::getSingletonPtr()->getSceneManager(it->second);
         if ("createSceneMode" == it->first)
             mCreateSceneMode = (it->second == CREATE_SCENE_MODE_AUTO)? true: false;
+        if (DOTSCENE_OPTION_RAYCAST_AT_LOAD == it->first)
+            mRaycastAtLoad = StringConverter::parseBool(it->second);
+        if (DOTSCENE_OPTION_PRIVATE_GROUP == it->first)
+            mPrivateGroup = StringConverter::parseBool(it->second);
+        if (DOTSCENE_OPTION_STATIC_BATCHING == it->first)
+            mStaticBatching = StringConverter::parseBool(it->second);
+        if (DOTSCENE_OPTION_STATIC_REGION_SIZE == it->first)
+            mStaticRegionSize = StringConverter::parseReal(it->second);
+        if (DOTSCENE_OPTION_INSTANCING == it->first)
+            mInstancing = StringConverter::parseBool(it->second);
+        if (DOTSCENE_OPTION_INSTANCING_THRESHOLD == it->first)
+            mInstancingThreshold = std::max(StringConverter::parseInt(it->second), 2);
+        if (DOTSCENE_OPTION_INSTANCING_BATCH_SIZE == it->first)
+            mInstancingBatchSize = std::max(StringConverter::parseInt(it->second), 1);
+        if (DOTSCENE_OPTION_INSTANCING_TECHNIQUE == it->first)
+        {
+            String technique = it->second;
+            StringUtil::toLowerCase(technique);
+            if ("shaderbased" == technique) mInstancingTechnique = InstanceManager::ShaderBased;
+            else if ("vtf" == technique) mInstancingTechnique = InstanceManager::TextureVTF;
+            else if ("hwbasic" == technique) mInstancingTechnique = InstanceManager::HWInstancingBasic;
+            else if ("hwvtf" == technique) mInstancingTechnique = InstanceManager::HWInstancingVTF;
+            else log("Error: Invalid instancing technique " + it->second);
+        }
+        if (DOTSCENE_OPTION_LOD_GENERATION == it->first)
+            mLodGeneration = StringConverter::parseBool(it->second);
+        if (DOTSCENE_OPTION_LOD_LEVELS == it->first)
+            mLodPolicy.mLevels = std::max(StringConverter::parseInt(it->second), 1);
+        if (DOTSCENE_OPTION_LOD_REDUCTION == it->first)
+            mLodPolicy.mReduction = Math::Clamp(StringConverter::parseReal(it->second), (Real)0, (Real)1);
+        if (DOTSCENE_OPTION_LOD_DISTANCE == it->first)
+            mLodPolicy.mLodDistance = std::max(StringConverter::parseReal(it->second), (Real)0);
+        if (DOTSCENE_OPTION_LOD_RENDERING_DISTANCE == it->first)
+            mLodPolicy.mRenderingDistance = std::max(StringConverter::parseReal(it->second), (Real)0);
+        if (DOTSCENE_OPTION_ANIMATION_LOD == it->first)
+            mAnimationLod = StringConverter::parseBool(it->second);
+        if (DOTSCENE_OPTION_ANIMATION_LOD_DISTANCE == it->first)
+            mAnimationLodDistance = std::max(StringConverter::parseReal(it->second), (Real)0);
+        if (DOTSCENE_OPTION_ANIMATION_LOD_INTERVAL == it->first)
+            mAnimationLodInterval = std::max(StringConverter::parseInt(it->second), 1);
+        if (DOTSCENE_OPTION_APPLY_GLOBAL_STATE == it->first)
+            mGlobalState = StringConverter::parseBool(it->second);
+        if (DOTSCENE_OPTION_KEEP_DOCUMENT == it->first)
+            mKeepDocument = StringConverter::parseBool(it->second);
+        if (DOTSCENE_OPTION_POSITION == it->first)
+            mRootPosition = StringConverter::parseVector3(it->second);
+        if (DOTSCENE_OPTION_ORIENTATION == it->first)
+            mRootOrientation = StringConverter::parseQuaternion(it->second);
+        if (DOTSCENE_OPTION_SCALE == it->first)
+            mRootScale = StringConverter::parseVector3(it->second);
     }
     
      for(int i=0; i<DOTSCENE_MAX_VIEWPORTS; i++)
@@ -231,6 +824,18 @@ DotScene::~DotScene()
     if (helper) 
         delete helper;
     helper = 0;
+    
+    delete mArena;
+    mArena = 0;
+    
+    delete mConstraints;
+    mConstraints = 0;
+    
+    delete mBounds;
+    mBounds = 0;
+    
+    delete mSnapshot;
+    mSnapshot = 0;
 }
 //----------------------------------------------------------------------------
 SceneManager* DotScene::getSceneManager()
@@ -259,11 +864,22 @@ void DotScene::loadImpl()
     mCameras.clear();
     mBillboardSets.clear();
     mParticleSystem.clear();
+    mParticleTemplates.clear();
     mExternals.clear();
     mMeshes.clear();
     mUserReferences.clear();
     mProperties.clear();
     mRenderTextures.clear();
+    mMovablePlanes.clear();
+    mAnimationStates.clear();
+    mNoteTracks.clear();
+    mNoteTime = 0;
+    mLayers.clear();
+    mHiddenLayers = 0;
+    mHandleNodes.clear();
+    mHandleIndex.clear();
+    //Handles from previous loads become stale
+    mHandleGeneration = (mHandleGeneration + 1) & 0xFF;
     
     mAmbientLight = ColourValue::White;
     mAnimationPackage = ANIMATION_PKG_OTHER;
@@ -279,74 +895,97 @@ void DotScene::loadImpl()
     mVisibilityFlags = 0;
  
     
-    //Load & parse scene file
-    TiXmlDocument* doc = 0;
-    TiXmlElement* rootNode = 0;
-    try
+    //Parsed scene file (shared by manager with other instances of same file)
+    DotSceneManager* manager = static_cast<DotSceneManager*>(mCreator);
+    TiXmlDocument* doc = manager->_acquireDocument(mFile, mGroup);
+    if (! doc)
     {
-        // Strip the path
-        ResourceGroupManager* resman = ResourceGroupManager::getSingletonPtr();
-        DataStreamPtr pStream = resman->openResource(mFile,mGroup);
-        
-        String data = pStream->getAsString();
-        
-        // Open the .scene File
-        doc = new TiXmlDocument();
-        doc->Parse( data.c_str() );
-        pStream->close();
-        pStream.setNull();
-
-        //Has parse error */
-        if (doc->Error())
-        {
-            log("Error parsing .dotscene resource" + mFile);
-            delete doc;
-            
-            assert(false);
-            return;
-        }
-    }
-    catch(...)
-    {
-        log("Error creating TiXmlDocument for file " + mFile);
-        delete doc;
-        
         assert(false);
         return;
     }
-
-    //Clean & init internal & scene resources
-    //cleanResources();
+    mDocumentAcquired = true;
     
     // Validate the File
-    rootNode = doc->RootElement(); 
-    if ("scene" != String(rootNode->Value())) 
+    TiXmlElement* rootNode = doc->RootElement(); 
+    if ((! rootNode) || ("scene" != String(rootNode->Value()))) 
     {
         log("Error: Invalid .scene File. Missing <scene> node");
-        delete doc;    
+        manager->_releaseDocument(mFile, mGroup);
+        mDocumentAcquired = false;
         
         assert(false);
         return;
     }
 
+    //evicted scenes are reloaded hidden & without touching viewports, cameras or environment
+    bool reloading = mEvicted;
+    mEvicted = false;
+    mApplyGlobalState = (mGlobalState) && (! reloading);
+    
     //backup current viewport configuracion
-    backupViewportConfiguration();
+    if (mApplyGlobalState)
+        backupViewportConfiguration();
 
+    //prefab definitions (instantiated from parsed document wherever referenced)
+    mPrefabs.clear();
+    mActivePrefabs.clear();
+    if (rootNode->FirstChildElement("prefabs"))
+        collectPrefabs(rootNode->FirstChildElement("prefabs"));
+    
+    //select repeated mesh/material pairs for automatic instancing
+    mInstancingPairs.clear();
+    if ((mInstancing) && (rootNode->FirstChildElement("nodes")))
+    {
+        countInstancingPairs(rootNode->FirstChildElement("nodes"));
+        
+        std::map<String, InstancingPairType>::iterator it = mInstancingPairs.begin();
+        while (mInstancingPairs.end() != it)
+        {
+            if (it->second.mCount < mInstancingThreshold)
+                mInstancingPairs.erase(it++);
+            else
+                it++;
+        }
+        log("Automatic instancing: " + stringify((int)mInstancingPairs.size()) + " mesh/material pairs");
+    }
+    
     // Process the scene - always work in radian units
     Math::AngleUnit angleUnit = Math::getAngleUnit();
     Math::setAngleUnit(Math::AU_RADIAN);
     processScene(rootNode);
     Math::setAngleUnit(angleUnit);
     
+    //userData layers (before batching: batches keep entities visibility flags)
+    applyLayers();
+    
+    //all nodes are in place: batch static entities
+    if (mBatchedEntities.size())
+        buildStaticBatches();
+    
+    //all nodes are in place: resolve look/track targets & apply them once
+    mConstraints->build(mSceneMgr);
+    mConstraints->update();
+    
+    //skinned entities animated by scene (distance based rates)
+    if (mAnimationLod)
+        buildAnimationLods();
+    
+    //note tracks follow animation states named as them
+    bindNoteTracks();
+    
+    //subtree bounds cached from now on (computed on first query)
+    mBounds->track(mSceneRoot);
+    
     //set lighting by default
-    setDefaultLighting();
+    if (mApplyGlobalState)
+        setDefaultLighting();
     
     //Exist viewport? 
     Root* root = Root::getSingletonPtr();
     RenderWindow* window = root->getAutoCreatedWindow();
     
     //Crear viewport  -  set camera por defecto
-    if (! mDefaultCameras.size())    //if (! window->getNumViewports())
+    if ((mApplyGlobalState) && (! mDefaultCameras.size()))    //if (! window->getNumViewports())
     {
         //Usar camera desde el fichero dotscene
         if (mCameras.size())
@@ -385,12 +1024,33 @@ void DotScene::loadImpl()
     }
         
         
+    //build name & path lookup indexes
+    buildNameIndex();
+    
+    //register resources used by scene (memory attribution)
+    collectResources();
+    static_cast<DotSceneManager*>(mCreator)->_notifyResourcesUsed(this);
+        
     //if Auto create scene flag is set attach sceneNode to RootSceneNode
-    if (mCreateSceneMode)
+    if ((mCreateSceneMode) && (! reloading))
         setVisible(true);
     
-    // Close the XML File
-    delete doc;
+    //build ray query accelerators now instead of on first query
+    if (mRaycastAtLoad)
+        buildRaycastData();
+    
+    //Prefabs point to parsed document
+    mPrefabs.clear();
+    
+    //Parsed document is only kept for instantiation (read only: never modified by loader)
+    if (! mKeepDocument)
+    {
+        manager->_releaseDocument(mFile, mGroup);
+        mDocumentAcquired = false;
+    }
+    
+    if (reloading)
+        static_cast<DotSceneManager*>(mCreator)->_notifySceneReloaded(this);
 }
 //----------------------------------------------------------------------------
 void DotScene::unloadImpl()
@@ -399,57 +1059,337 @@ void DotScene::unloadImpl()
     
     cleanResources();
     
+    //objects are destroyed: resources no longer used by other scenes are released
+    static_cast<DotSceneManager*>(mCreator)->_notifyResourcesReleased(this);
+    for(int t=0; t<RESOURCE_TYPE_COUNT; t++)
+        mResources[t].clear();
+    
     //recuperamos la configuracion de cameras y viewport
     restoreViewportConfiguration();
+    
+    //parsed document kept for instantiation
+    if (mDocumentAcquired)
+        static_cast<DotSceneManager*>(mCreator)->_releaseDocument(mFile, mGroup);
+    mDocumentAcquired = false;
+    
+    //release bookkeeping (properties, backups, planes) in one operation
+    mArena->release();
 }
 //----------------------------------------------------------------------------
 size_t DotScene::calculateSize() const
 {
     TRACE_FUNC();
     
-    int sz = 0;
-    sz += mSceneNodes.size();
-    sz += mSceneNodes.size();
-    sz += mDynamicEntities.size();
-    sz += mStaticEntities.size();
-    sz += mLights.size();
-    sz += mCameras.size();
-    sz += mBillboardSets.size();
-    sz += mParticleSystem.size();
-    sz += mExternals.size();
-    sz += mMeshes.size();
-    sz += mUserReferences.size();
-
-    return sz;
+    //ResourceManager keeps this value until unload (sharing may change later)
+    return getMemoryBreakdown().getTotal();
+}
+//----------------------------------------------------------------------------
+DotSceneMemoryBreakdown DotScene::getMemoryBreakdown() const
+{
+    DotSceneMemoryBreakdown breakdown;
+    
+    //Library structures
+    const DotSceneStringVector* lists[] = { &mSceneNodes, &mDynamicEntities, &mStaticEntities, &mLights, &mCameras, 
+                                            &mBillboardSets, &mParticleSystem, &mMeshes, &mRenderTextures, &mUserReferences };
+    
+    breakdown.mBookkeeping = sizeof(DotScene) + mArena->getStats().mBytesReserved;
+    for(int l=0; l<10; l++)
+        breakdown.mBookkeeping += lists[l]->capacity() * sizeof(DotSceneString);
+    breakdown.mBookkeeping += mProperties.capacity() * sizeof(NodeProperty*);
+    breakdown.mBookkeeping += mMovablePlanes.capacity() * sizeof(MovablePlane*);
+    breakdown.mBookkeeping += mAnimationStates.capacity() * sizeof(AnimationState*);
+    breakdown.mBookkeeping += mNoteTracks.capacity() * sizeof(NoteTrackType);
+    for(std::vector<NoteTrackType>::const_iterator it=mNoteTracks.begin(); it!=mNoteTracks.end(); it++)
+        breakdown.mBookkeeping += it->mNotes.capacity() * sizeof(NoteType);
+    
+    const NameIndexType* indexes[] = { &mNameIndex, &mPathIndex };
+    for(int i=0; i<2; i++)
+    {
+        breakdown.mBookkeeping += indexes[i]->capacity() * sizeof(NameIndexEntryType);
+        for(NameIndexType::const_iterator it=indexes[i]->begin(); it!=indexes[i]->end(); it++)
+            breakdown.mBookkeeping += it->mKey.capacity();
+    }
+    
+    std::map<String, DotSceneMeshBVH*>::const_iterator it_bvh;
+    for(it_bvh=mMeshBVHs.begin(); it_bvh!=mMeshBVHs.end(); it_bvh++)
+        breakdown.mBookkeeping += it_bvh->second->getMemoryUsage();
+    
+    breakdown.mBookkeeping += mConstraints->getMemoryUsage();
+    breakdown.mBookkeeping += mBounds->getMemoryUsage();
+    breakdown.mBookkeeping += mSnapshot->getMemoryUsage();
+    
+    for(int t=0; t<RESOURCE_TYPE_COUNT; t++)
+        breakdown.mBookkeeping += mResources[t].size() * (sizeof(DotSceneString) + 4 * sizeof(void*));
+    
+    //Ogre objects & resources
+    if (mSceneMgr)
+        breakdown.mSceneObjects = getSceneObjectsMemory();
+    breakdown.mMeshes = getResourcesMemory(RESOURCE_MESH);
+    breakdown.mMaterials = getResourcesMemory(RESOURCE_MATERIAL);
+    breakdown.mTextures = getResourcesMemory(RESOURCE_TEXTURE);
+    
+    return breakdown;
+}
+//----------------------------------------------------------------------------
+size_t DotScene::getSceneObjectsMemory() const
+{
+    size_t size = 0;
+    
+    size += mSceneNodes.size() * sizeof(SceneNode);
+    size += mLights.size() * sizeof(Light);
+    size += mCameras.size() * sizeof(Camera);
+    size += mInstancedEntities.size() * sizeof(InstancedEntity);
+    
+    //Entities: subentities & skeleton instance
+    const DotSceneStringVector* entities[] = { &mDynamicEntities, &mStaticEntities };
+    for(int l=0; l<2; l++)
+    {
+        for(DotSceneStringVector::const_iterator it=entities[l]->begin(); it!=entities[l]->end(); it++)
+        {
+            if (! mSceneMgr->hasEntity(*it))
+                continue;
+            
+            Entity* entity = mSceneMgr->getEntity(*it);
+            size += sizeof(Entity) + entity->getNumSubEntities() * sizeof(SubEntity);
+            if (entity->hasSkeleton())
+                size += sizeof(SkeletonInstance) + entity->getSkeleton()->getNumBones() * sizeof(Bone);
+        }
+    }
+    
+    //Particle systems & billboards: pools are allocated upfront
+    for(DotSceneStringVector::const_iterator it=mParticleSystem.begin(); it!=mParticleSystem.end(); it++)
+    {
+        if (! mSceneMgr->hasParticleSystem(*it))
+            continue;
+        
+        ParticleSystem* particleSystem = mSceneMgr->getParticleSystem(*it);
+        size += sizeof(ParticleSystem) + particleSystem->getParticleQuota() * sizeof(Particle);
+    }
+    for(DotSceneStringVector::const_iterator it=mBillboardSets.begin(); it!=mBillboardSets.end(); it++)
+    {
+        if (! mSceneMgr->hasBillboardSet(*it))
+            continue;
+        
+        BillboardSet* billboardSet = mSceneMgr->getBillboardSet(*it);
+        size += sizeof(BillboardSet) + billboardSet->getPoolSize() * sizeof(Billboard);
+    }
+    
+    return size;
+}
+//----------------------------------------------------------------------------
+size_t DotScene::getResourcesMemory(DotSceneResourceType type) const
+{
+    //particle templates are not resources (memory not tracked)
+    ResourceManager* managers[] = { MeshManager::getSingletonPtr(), 
+                                    MaterialManager::getSingletonPtr(), 
+                                    TextureManager::getSingletonPtr(),
+                                    0 };
+    if (! managers[type])
+        return 0;
+    
+    DotSceneManager* manager = static_cast<DotSceneManager*>(mCreator);
+    
+    size_t size = 0;
+    for(DotSceneResourceSet::const_iterator it=mResources[type].begin(); it!=mResources[type].end(); it++)
+    {
+        ResourcePtr resource = managers[type]->getByName(*it);
+        if (resource.isNull() || (! resource->isLoaded()))
+            continue;
+        
+        //shared resources are attributed proportionally
+        size_t users = std::max(manager->getResourceUsers(type, *it), (size_t)1);
+        size += resource->getSize() / users;
+    }
+    
+    return size;
+}
+//----------------------------------------------------------------------------
+const String& DotScene::getFile() const
+{
+    return mFile;
+}
+//----------------------------------------------------------------------------
+const NameValuePairList& DotScene::getOptions() const
+{
+    return mOptions;
+}
+//----------------------------------------------------------------------------
+bool DotScene::isResourceGroupPrivate() const
+{
+    return mPrivateGroup;
+}
+//----------------------------------------------------------------------------
+const DotSceneResourceSet& DotScene::getResources(DotSceneResourceType type) const
+{
+    assert(type < RESOURCE_TYPE_COUNT);
+    return mResources[type];
+}
+//----------------------------------------------------------------------------
+void DotScene::collectResources()
+{
+    TRACE_FUNC();
+    
+    for(int t=0; t<RESOURCE_TYPE_COUNT; t++)
+        mResources[t].clear();
+    
+    //Scene meshes (planes & manual meshes)
+    mResources[RESOURCE_MESH].insert(mMeshes.begin(), mMeshes.end());
+    
+    //Entities: mesh & subentity materials
+    DotSceneStringVector* entities[] = { &mDynamicEntities, &mStaticEntities };
+    for(int l=0; l<2; l++)
+    {
+        for(DotSceneStringVector::iterator it=entities[l]->begin(); it!=entities[l]->end(); it++)
+        {
+            Entity* entity = mSceneMgr->getEntity(*it);
+            mResources[RESOURCE_MESH].insert(entity->getMesh()->getName());
+            
+            for(unsigned int i=0; i<entity->getNumSubEntities(); i++)
+                collectMaterial(entity->getSubEntity(i)->getMaterialName());
+        }
+    }
+    
+    //Instanced entities: mesh & batch material
+    std::map<String, InstancingPairType>::iterator it_pair;
+    for(it_pair=mInstancingPairs.begin(); it_pair!=mInstancingPairs.end(); it_pair++)
+    {
+        if (StringUtil::BLANK == it_pair->second.mManager)
+            continue;
+        mResources[RESOURCE_MESH].insert(it_pair->second.mMesh);
+        collectMaterial(it_pair->second.mMaterial);
+    }
+    
+    //Particle systems & billboards materials
+    mResources[RESOURCE_PARTICLE_TEMPLATE].insert(mParticleTemplates.begin(), mParticleTemplates.end());
+    for(DotSceneStringVector::iterator it=mParticleSystem.begin(); it!=mParticleSystem.end(); it++)
+        collectMaterial(mSceneMgr->getParticleSystem(*it)->getMaterialName());
+    for(DotSceneStringVector::iterator it=mBillboardSets.begin(); it!=mBillboardSets.end(); it++)
+        collectMaterial(mSceneMgr->getBillboardSet(*it)->getMaterialName());
+}
+//----------------------------------------------------------------------------
+void DotScene::collectMaterial(const String& material)
+{
+    if ((StringUtil::BLANK == material) || (! mResources[RESOURCE_MATERIAL].insert(material).second))
+        return;
+    
+    MaterialPtr materialPtr = MaterialManager::getSingletonPtr()->getByName(material);
+    if (materialPtr.isNull())
+        return;
+    
+    //Textures referenced by any technique
+    Material::TechniqueIterator it_technique = materialPtr->getTechniqueIterator();
+    while (it_technique.hasMoreElements())
+    {
+        Technique::PassIterator it_pass = it_technique.getNext()->getPassIterator();
+        while (it_pass.hasMoreElements())
+        {
+            Pass::TextureUnitStateIterator it_unit = it_pass.getNext()->getTextureUnitStateIterator();
+            while (it_unit.hasMoreElements())
+            {
+                TextureUnitState* unit = it_unit.getNext();
+                for(unsigned int i=0; i<unit->getNumFrames(); i++)
+                {
+                    const String& texture = unit->getFrameTextureName(i);
+                    if (StringUtil::BLANK != texture)
+                        mResources[RESOURCE_TEXTURE].insert(texture);
+                }
+            }
+        }
+    }
 }
 //----------------------------------------------------------------------------
 void DotScene::cleanResources()
 {
-    for(StringVector::iterator it= mLights.begin(); it!=mLights.end(); it++)
+    //Sleeping objects restored before being destroyed (render textures may outlive scene)
+    if (mSleeping)
+        resume(0);
+    mSleeping = false;
+    
+    for(DotSceneStringVector::iterator it= mLights.begin(); it!=mLights.end(); it++)
         mSceneMgr->destroyLight(*it);
-    for(StringVector::iterator it= mBillboardSets.begin(); it!=mBillboardSets.end(); it++)
+    for(DotSceneStringVector::iterator it= mBillboardSets.begin(); it!=mBillboardSets.end(); it++)
         mSceneMgr->destroyBillboardSet(*it);
-    for(StringVector::iterator it= mMeshes.begin(); it!=mMeshes.end(); it++)
-        mSceneMgr->destroyManualObject(*it);
-    for(StringVector::iterator it= mParticleSystem.begin(); it!=mParticleSystem.end(); it++)
+    for(DotSceneStringVector::iterator it= mParticleSystem.begin(); it!=mParticleSystem.end(); it++)
         mSceneMgr->destroyParticleSystem(*it);
     
-    for(StringVector::iterator it= mCameras.begin(); it!=mCameras.end(); it++)
+    for(DotSceneStringVector::iterator it= mCameras.begin(); it!=mCameras.end(); it++)
             mSceneMgr->destroyCamera(*it);
     
+    //Destroy instanced entities & its managers
+    std::map<DotSceneString, InstancedEntity*>::iterator it_instanced;
+    for(it_instanced=mInstancedEntities.begin(); it_instanced!=mInstancedEntities.end(); it_instanced++)
+        mSceneMgr->destroyInstancedEntity(it_instanced->second);
+    for(DotSceneStringVector::iterator it= mInstanceManagers.begin(); it!=mInstanceManagers.end(); it++)
+        mSceneMgr->destroyInstanceManager(*it);
+    
+    //Destroy static batches & geometries (before its entities)
+    for(DotSceneStringVector::iterator it= mStaticGeometries.begin(); it!=mStaticGeometries.end(); it++)
+        mSceneMgr->destroyStaticGeometry(*it);
+    for(DotSceneStringVector::iterator it= mInstancedGeometries.begin(); it!=mInstancedGeometries.end(); it++)
+        mSceneMgr->destroyInstancedGeometry(*it);
+    
+    //Cached bounds listen scene nodes
+    mBounds->clear();
+    
+    //Layers hidden by this scene released (other scenes may keep them hidden)
+    if (mHiddenLayers)
+        static_cast<DotSceneManager*>(mCreator)->_setLayersHidden(mHiddenLayers, false);
+    mHiddenLayers = 0;
+    
+    //Skinned entities scheduled by animation LOD
+    mSkeletalLods.clear();
+    mSkeletalDue.clear();
+    //Note tracks reference animation states
+    mNoteTracks.clear();
+    
+    //Destroy node animations (tracks reference scene nodes)
+    for(std::vector<AnimationState*>::iterator it=mAnimationStates.begin(); it!=mAnimationStates.end(); it++)
+    {
+        String name = (*it)->getAnimationName();
+        mSceneMgr->destroyAnimationState(name);
+        mSceneMgr->destroyAnimation(name);
+    }
+    mAnimationStates.clear();
+    
     //Destroy scene nodes
-    for(StringVector::iterator it= mStaticEntities.begin(); it!=mStaticEntities.end(); it++)
+    for(DotSceneStringVector::iterator it= mStaticEntities.begin(); it!=mStaticEntities.end(); it++)
         mSceneMgr->destroyEntity(*it);
-    for(StringVector::iterator it= mDynamicEntities.begin(); it!=mDynamicEntities.end(); it++)
+    for(DotSceneStringVector::iterator it= mDynamicEntities.begin(); it!=mDynamicEntities.end(); it++)
         mSceneMgr->destroyEntity(*it);
-    for(StringVector::iterator it= mSceneNodes.begin(); it!=mSceneNodes.end(); it++)
+    for(DotSceneStringVector::iterator it= mSceneNodes.begin(); it!=mSceneNodes.end(); it++)
         mSceneMgr->destroySceneNode(*it);        
+    
+    //Constraints reference scene nodes
+    mConstraints->clear();
+    //Handles & snapshot reference scene nodes
+    mHandleNodes.clear();
+    mHandleIndex.clear();
+    mSnapshot->clear();
+    
+    //Destroy ray query accelerators
+    destroyRaycastData();
+    
+    //Detach movable planes (memory owned by arena)
+    for(std::vector<MovablePlane*>::iterator it=mMovablePlanes.begin(); it!=mMovablePlanes.end(); it++)
+    {
+        if ((*it)->isAttached())
+            (*it)->detachFromParent();
+    }
+    
+    //Uninstall shadow camera setup (may reference an arena plane)
+    if ((! mShadowCameraSetup.isNull()) && 
+        (mSceneMgr->getShadowCameraSetup().getPointer() == mShadowCameraSetup.getPointer()))
+    {
+        mSceneMgr->setShadowCameraSetup(ShadowCameraSetupPtr(new DefaultShadowCameraSetup()));
+    }
+    mShadowCameraSetup.setNull();
             
     //Clean scene
     mSceneRoot->setVisible(false);    
     setVisible(false);
     mSceneMgr->destroySceneNode(mSceneRoot);
     mSceneRoot = 0;
+    mNodesRoot = 0;
         
     //Clean local structures
     mSceneNodes.clear();
@@ -459,6 +1399,7 @@ void DotScene::cleanResources()
     mCameras.clear();
     mBillboardSets.clear();
     mParticleSystem.clear();
+    mParticleTemplates.clear();
     mExternals.clear();
     mMeshes.clear();
     mUserReferences.clear();
@@ -466,6 +1407,17 @@ void DotScene::cleanResources()
     mDefaultCameras.clear();
     mProperties.clear();
     mRenderTextures.clear(); 
+    mStaticGeometries.clear();
+    mInstancedGeometries.clear();
+    mHiddenGeometries.clear();
+    mBatchedEntities.clear();
+    mInstanceManagers.clear();
+    mInstancedEntities.clear();
+    mInstancedNames.clear();
+    mInstancingPairs.clear();
+    mMovablePlanes.clear();
+    mNameIndex.clear();
+    mPathIndex.clear();
 }
 //----------------------------------------------------------------------------
 Quaternion DotScene::getUpAxisOrientation()
@@ -507,7 +1459,7 @@ void DotScene::backupViewportConfiguration()
         {
             Viewport* viewport = window->getViewport(i);
             
-            ViewportConfigurationType* backup = new ViewportConfigurationType();
+            ViewportConfigurationType* backup = mArena->create<ViewportConfigurationType>();
             backup->mTop = viewport->getTop();
             backup->mLeft = viewport->getLeft();
             backup->mHeight = viewport->getHeight();
@@ -627,7 +1579,8 @@ void DotScene::restoreViewportConfiguration()
             window->addViewport(camera, backup->mZOrder, backup->mTop, backup->mLeft, backup->mWidth, backup->mHeight);
         }
         
-        delete backup; backup = 0; mBackupViewport[i] = 0;
+        //memory owned by arena
+        backup = 0; mBackupViewport[i] = 0;
     }
 }
 //----------------------------------------------------------------------------
@@ -638,6 +1591,12 @@ const String& DotScene::getName()
 //----------------------------------------------------------------------------
 void DotScene::setVisible(bool visible)
 {
+    //Evicted scene: reload on demand
+    if ((visible) && (mEvicted) && (LOADSTATE_UNLOADED == getLoadingState()))
+        load();
+    if (! mSceneRoot)
+        return;
+    
     //Check if my scene root node and scene manager root mode is the same
     
     if (mSceneMgr->getRootSceneNode()->getName() == mSceneRoot->getName())
@@ -654,11 +1613,33 @@ void DotScene::setVisible(bool visible)
         if ((! visible) && ( mSceneRoot->isInSceneGraph()))
             mSceneMgr->getRootSceneNode()->removeChild(mSceneRoot);
     }
+    
+    //Static & instanced geometries are attached to scene manager root node (keep authored hidden ones)
+    for(DotSceneStringVector::iterator it=mStaticGeometries.begin(); it!=mStaticGeometries.end(); it++)
+        mSceneMgr->getStaticGeometry(*it)->setVisible(visible && (! mHiddenGeometries.count(*it)));
+    for(DotSceneStringVector::iterator it=mInstancedGeometries.begin(); it!=mInstancedGeometries.end(); it++)
+        mSceneMgr->getInstancedGeometry(*it)->setVisible(visible && (! mHiddenGeometries.count(*it)));
+    
+    //Last statement: manager may evict this scene
+    static_cast<DotSceneManager*>(mCreator)->_notifySceneVisibility(this, visible);
 }
 //----------------------------------------------------------------------------
 bool DotScene::getVisible(void)
 {
-    return mSceneRoot->isInSceneGraph();
+    return (mSceneRoot) && (mSceneRoot->isInSceneGraph());
+}
+//----------------------------------------------------------------------------
+bool DotScene::isEvicted() const
+{
+    return mEvicted;
+}
+//----------------------------------------------------------------------------
+void DotScene::_evict()
+{
+    TRACE_FUNC();
+    
+    unload();
+    mEvicted = true;
 }
 //----------------------------------------------------------------------------
 void DotScene::processScene(TiXmlElement* root)
@@ -667,26 +1648,26 @@ void DotScene::processScene(TiXmlElement* root)
     
     // Process the scene parameters
     String str = getAttrib(root, "formatVersion", "unknown");
-    mProperties.push_back(new SceneNodeProperty<DotScene>(this,"formatVersion",str,SCENE));
+    createProperty<DotScene>(this,"formatVersion",str,SCENE);
     str = getAttrib(root, "id", "unknown");
-    mProperties.push_back(new SceneNodeProperty<DotScene>(this,"id",str,SCENE));
+    createProperty<DotScene>(this,"id",str,SCENE);
     str = getAttrib(root, "minOgreVersion", OGRE_VERSION_NAME);
-    mProperties.push_back(new SceneNodeProperty<DotScene>(this,"minOgreVersion",str,SCENE));
+    createProperty<DotScene>(this,"minOgreVersion",str,SCENE);
     str = getAttrib(root, "author", "iBIT");
-    mProperties.push_back(new SceneNodeProperty<DotScene>(this,"author",str,SCENE));
+    createProperty<DotScene>(this,"author",str,SCENE);
     str = getAttrib(root, "sceneManager", mSceneMgr->getName().c_str());
-    mProperties.push_back(new SceneNodeProperty<DotScene>(this,"sceneManager",str,SCENE));
+    createProperty<DotScene>(this,"sceneManager",str,SCENE);
     str = getAttrib(root, "upAxis", "y");
-    mProperties.push_back(new SceneNodeProperty<DotScene>(this,"upAxis",str,SCENE));
+    createProperty<DotScene>(this,"upAxis",str,SCENE);
     str = getAttrib(root, "unitsPerMeter", "100");
-    mProperties.push_back(new SceneNodeProperty<DotScene>(this,"unitsPerMeter",str,SCENE));
+    createProperty<DotScene>(this,"unitsPerMeter",str,SCENE);
     str = getAttrib(root, "unitType", "centimeters");
-    mProperties.push_back(new SceneNodeProperty<DotScene>(this,"unitType",str,SCENE));
+    createProperty<DotScene>(this,"unitType",str,SCENE);
     str = getAttrib(root, "ogreMaxVersion", "unknown");
-    mProperties.push_back(new SceneNodeProperty<DotScene>(this,"ogreMaxVersion",str,SCENE));
+    createProperty<DotScene>(this,"ogreMaxVersion",str,SCENE);
     str = getAttrib(root, "application", "unknown");
     {
-        mProperties.push_back(new SceneNodeProperty<DotScene>(this,"application",str,SCENE));
+        createProperty<DotScene>(this,"application",str,SCENE);
         StringUtil::toLowerCase(str);
         
         mAnimationPackage = ANIMATION_PKG_OTHER;
@@ -701,15 +1682,31 @@ void DotScene::processScene(TiXmlElement* root)
     assert(! mSceneRoot);
     
     //Set default ambient light
-    mSceneMgr->setAmbientLight(mAmbientLight);
+    if (mApplyGlobalState)
+        mSceneMgr->setAmbientLight(mAmbientLight);
     
     assert(! mSceneMgr->hasSceneNode(mPrefix + this->getName() + "RootNode")); //Nunca deberia pasar
     
     mSceneRoot = mSceneMgr->createSceneNode(mPrefix + this->getName() + "RootNode");
     //mSceneNodes.push_back(mSceneRoot->getName());
     
-    // Process nodes (?)
-    elem = root->FirstChildElement("nodes");
+    //Instance transform
+    mSceneRoot->setPosition(mRootPosition);
+    mSceneRoot->setOrientation(mRootOrientation);
+    mSceneRoot->setScale(mRootScale);
+    
+    // Process queryFlags (?): default for objects
+    elem = root->FirstChildElement("queryFlags");
+    if (elem)
+        mQueryFlags = parseQueryFlags(elem);
+    
+    // Process visibilityFlags (?): named layers
+    elem = root->FirstChildElement("visibilityFlags");
+    if (elem)
+        mVisibilityFlags = parseVisibilityFlags(elem);
+    
+    // Process nodes (?)
+    elem = root->FirstChildElement("nodes");
     if (elem)
         processNodes(elem);
 
@@ -720,7 +1717,7 @@ void DotScene::processScene(TiXmlElement* root)
 
     // Process environment (?)
     elem = root->FirstChildElement("environment");
-    if (elem)
+    if ((elem) && (mApplyGlobalState))
         processEnvironment(elem);
 
     // Process terrain (?)
@@ -748,16 +1745,6 @@ void DotScene::processScene(TiXmlElement* root)
     if (elem)
         processRenderTextures(elem);
     
-    // Process queryFlags (?)
-    elem = root->FirstChildElement("queryFlags");
-    if (elem)
-        mQueryFlags = parseQueryFlags(elem);
-    
-    // Process visibilityFlags (?)
-    elem = root->FirstChildElement("visibilityFlags");
-    if (elem)
-        mVisibilityFlags = parseVisibilityFlags(elem);
-    
     // Process instancedGeometries (?)
     elem = root->FirstChildElement("instancedGeometries");
     if (elem)
@@ -796,8 +1783,10 @@ void DotScene::processNodes(TiXmlElement* node)
     
     TiXmlElement* elem = 0;
 
-    SceneNode* sceneNode = mSceneRoot->createChildSceneNode(mPrefix + "Nodes" + generateUUID());
+    //Deterministic name: scene names are unique in manager
+    SceneNode* sceneNode = mSceneRoot->createChildSceneNode(mPrefix + this->getName() + "Nodes");
     mSceneNodes.push_back(sceneNode->getName());
+    mNodesRoot = sceneNode;
     
     // Process position (?)
     elem = node->FirstChildElement("position");
@@ -830,6 +1819,14 @@ void DotScene::processNodes(TiXmlElement* node)
         elem = elem->NextSiblingElement("node");
     }
     
+    // Process instance (*)
+    elem = node->FirstChildElement("instance");
+    while(elem)
+    {
+        processInstance(elem, sceneNode);
+        elem = elem->NextSiblingElement("instance");
+    }
+    
     // Process userdata (*)
     elem = node->FirstChildElement("userData");
     while(elem)
@@ -852,9 +1849,10 @@ void DotScene::processNode(TiXmlElement* node, SceneNode* parent)
     assert(parent);
     
     // Construct the node's name
-    String name = mPrefix + getAttrib(node, "name");
+    String name = getAttrib(node, "name");
+    name = (name.empty())? name: mPrefix + name;
 
-    // Create the scene node
+    // Create the scene node (unnamed: generated by Ogre)
     SceneNode* sceneNode;
     if(name.empty())
         sceneNode = parent->createChildSceneNode();
@@ -902,6 +1900,16 @@ void DotScene::processNode(TiXmlElement* node, SceneNode* parent)
     //set initial state
     sceneNode->setInitialState();
     
+    processNodeChildren(node, sceneNode);
+}
+//----------------------------------------------------------------------------
+void DotScene::processNodeChildren(TiXmlElement* node, SceneNode* sceneNode)
+{
+    TRACE_FUNC();
+    assert(sceneNode);
+    
+    TiXmlElement* elem = 0;
+    
     // Process lookTarget (?)
     elem = node->FirstChildElement("lookTarget");
     if (elem)
@@ -919,6 +1927,14 @@ void DotScene::processNode(TiXmlElement* node, SceneNode* parent)
         processNode(elem, sceneNode);
         elem = elem->NextSiblingElement("node");
     }
+    
+    // Process instance (*)
+    elem = node->FirstChildElement("instance");
+    while(elem)
+    {
+        processInstance(elem, sceneNode);
+        elem = elem->NextSiblingElement("instance");
+    }
 
     // Process entity (*)
     elem = node->FirstChildElement("entity");
@@ -968,17 +1984,22 @@ void DotScene::processNode(TiXmlElement* node, SceneNode* parent)
         elem = elem->NextSiblingElement("plane");
     }
 
-    // Process plane (*)
+    // Process animations (?)
     elem = node->FirstChildElement("animations");
     if(elem)
     {
-        TiXmlElement* child = node->FirstChildElement("animation");
+        TiXmlElement* child = elem->FirstChildElement("animation");
         while(child)
         {
-            processAnimation(elem, sceneNode);
-            elem = elem->NextSiblingElement();
+            processAnimation(child, sceneNode);
+            child = child->NextSiblingElement("animation");
         }
     }
+    
+    // Process noteTracks (?)
+    elem = node->FirstChildElement("noteTracks");
+    if (elem)
+        processNoteTracks(elem, sceneNode->getName());
 
     // Process userdata (*)
     elem = node->FirstChildElement("userData");
@@ -996,6 +2017,101 @@ void DotScene::processNode(TiXmlElement* node, SceneNode* parent)
     }
 }
 //----------------------------------------------------------------------------
+void DotScene::processInstance(TiXmlElement* node, SceneNode* parent)
+{
+    TRACE_FUNC();
+    assert(parent);
+    
+    //<instance ref="prefab" name="string" visible="bool"> position, rotation, scale, userData </instance>
+    String ref = getAttrib(node, "ref");
+    std::map<String, TiXmlElement*>::iterator it = mPrefabs.find(ref);
+    if (mPrefabs.end() == it)
+    {
+        log("Error: Undefined prefab " + ref);
+        return;
+    }
+    if (mActivePrefabs.count(ref))
+    {
+        log("Error: Recursive prefab reference " + ref);
+        return;
+    }
+    TiXmlElement* prefab = it->second;
+    
+    // Construct the node's name (instances need a name: it prefixes prefab objects)
+    String instanceName = getAttrib(node, "name");
+    if (StringUtil::BLANK == instanceName)
+        instanceName = ref + stringify((int)mSceneNodes.size());
+    String name = mPrefix + instanceName;
+    
+    SceneNode* sceneNode = parent->createChildSceneNode(name);
+    mSceneNodes.push_back(sceneNode->getName());
+    
+    bool visible = getAttribBool(node, "visible", getAttribBool(prefab, "visible", true));
+    sceneNode->setVisible(visible);
+    
+    // Prefab transform, overridden by instance transform (?)
+    TiXmlElement* elem = 0;
+    TiXmlElement* source[2] = {prefab, node};
+    for(int i=0; i<2; i++)
+    {
+        elem = source[i]->FirstChildElement("position");
+        if (elem)
+            sceneNode->setPosition(mUnitConversionFactor * parseVector3(elem));
+        
+        elem = source[i]->FirstChildElement("rotation");
+        if (elem)
+            sceneNode->setOrientation(parseQuaternion(elem));
+        
+        elem = source[i]->FirstChildElement("quaternion");
+        if (elem)
+            sceneNode->setOrientation(parseQuaternion(elem));
+        
+        elem = source[i]->FirstChildElement("scale");
+        if (elem)
+            sceneNode->setScale(parseVector3(elem));
+    }
+    
+    //set initial state
+    sceneNode->setInitialState();
+    
+    // Prefab content: objects named "<instance>.<object>"
+    String prefix = mPrefix;
+    mPrefix = name + ".";
+    mActivePrefabs.insert(ref);
+    
+    processNodeChildren(prefab, sceneNode);
+    
+    mActivePrefabs.erase(ref);
+    mPrefix = prefix;
+    
+    // Process instance userdata (*)
+    elem = node->FirstChildElement("userData");
+    while(elem)
+    {
+        processUserData<SceneNode>(elem, sceneNode, SCENE_NODE);
+        elem = elem->NextSiblingElement("userData");
+    } 
+}
+//----------------------------------------------------------------------------
+void DotScene::collectPrefabs(TiXmlElement* node)
+{
+    TRACE_FUNC();
+    
+    //<prefabs><prefab name="string"> 'node' content </prefab></prefabs>
+    TiXmlElement* elem = node->FirstChildElement("prefab");
+    while(elem)
+    {
+        String name = getAttrib(elem, "name");
+        if (StringUtil::BLANK == name)
+            log("Error: Prefab without name");
+        else if (! mPrefabs.insert(std::make_pair(name, elem)).second)
+            log("Error: Duplicated prefab " + name);
+        
+        elem = elem->NextSiblingElement("prefab");
+    }
+    log("Prefabs: " + stringify((int)mPrefabs.size()));
+}
+//----------------------------------------------------------------------------
 void DotScene::processExternals(TiXmlElement* node)
 {
     TRACE_FUNC();
@@ -1349,7 +2465,7 @@ void DotScene::processLight(TiXmlElement* node, SceneNode* parent)
     if (visibilityFlags) 
         light->setVisibilityFlags(visibilityFlags);
     if (queryFlags) 
-        light->setVisibilityFlags(queryFlags);
+        light->setQueryFlags(queryFlags);
     //
     
     TiXmlElement* elem = 0;
@@ -1420,9 +2536,9 @@ void DotScene::processLight(TiXmlElement* node, SceneNode* parent)
         processLightAttenuation(elem, light);
 
     // Process noteTracks (?)
-//     elem = node->FirstChildElement("noteTracks");
-//     if (elem)
-//         processNoteTrack(elem);
+    elem = node->FirstChildElement("noteTracks");
+    if (elem)
+        processNoteTracks(elem, name);
     
     // Process userdata (*)
     elem = node->FirstChildElement("userData");
@@ -1475,7 +2591,7 @@ void DotScene::processCamera(TiXmlElement* node, SceneNode* parent)
     if (visibilityFlags) 
         camera->setVisibilityFlags(visibilityFlags);
     if (queryFlags) 
-        camera->setVisibilityFlags(queryFlags);
+        camera->setQueryFlags(queryFlags);
     
     //Attach to node (if required)
     if(parent)
@@ -1536,10 +2652,10 @@ void DotScene::processCamera(TiXmlElement* node, SceneNode* parent)
     if (elem)
         processTrackTarget(elem, parent);
     
-    // Process trackTarget (?)
-//     elem = node->FirstChildElement("noteTracks");
-//     if (elem)
-//         processNoteTrack(elem);
+    // Process noteTracks (?)
+    elem = node->FirstChildElement("noteTracks");
+    if (elem)
+        processNoteTracks(elem, name);
     
     // Process userdata (*)
     elem = node->FirstChildElement("userData");
@@ -1560,14 +2676,13 @@ void DotScene::processCamera(TiXmlElement* node, SceneNode* parent)
     bool isdefault = boost::algorithm::ends_with(name, "default");
     isdefault |= getPropertyBool(name,"default");
     
-     if (isdefault)
+     if ((isdefault) && (mApplyGlobalState))
         setDefaultCamera(name);
 }
 //----------------------------------------------------------------------------
 void DotScene::processLookTarget(TiXmlElement* node, SceneNode* parent)
 {
     TRACE_FUNC();
-    assert(false);
     
     // Process attributes
     String nodeName = getAttrib(node, "nodeName");
@@ -1595,22 +2710,21 @@ void DotScene::processLookTarget(TiXmlElement* node, SceneNode* parent)
     if (elem)
         localDirection = parseVector3(elem);
 
-    SceneNode* lookTargetNode = 0;
-    // Setup the look target
-    try
+    // Setup the look target: node targets are evaluated on update (constraint engine)
+    if (StringUtil::BLANK != nodeName)
     {
-        if (StringUtil::BLANK != nodeName)
-        {
-            lookTargetNode = mSceneMgr->getSceneNode(nodeName);
-            position = lookTargetNode->_getDerivedPosition();
-        }
-
-        parent->lookAt(position, relativeTo, localDirection);
+        mConstraints->add(parent, mPrefix + nodeName, nodeName, localDirection, Vector3::ZERO);
     }
-    catch(Exception &e)
+    else
     {
-        log("[DotScene] Error processing a look target! -> " + e.getFullDescription());
-        assert(false);
+        try
+        {
+            parent->lookAt(position, relativeTo, localDirection);
+        }
+        catch(Exception &e)
+        {
+            log("[DotScene] Error processing a look target! -> " + e.getFullDescription());
+        }
     }
     
     // Process userdata (*)
@@ -1632,7 +2746,6 @@ void DotScene::processLookTarget(TiXmlElement* node, SceneNode* parent)
 void DotScene::processTrackTarget(TiXmlElement* node, SceneNode* parent)
 {
     TRACE_FUNC();
-    assert(false);
     
     // Process attributes
     String nodeName = getAttrib(node, "nodeName");
@@ -1651,18 +2764,11 @@ void DotScene::processTrackTarget(TiXmlElement* node, SceneNode* parent)
     if (elem)
         offset = parseVector3(elem);
 
-    // Setup the track target
-    SceneNode* trackTargetNode = 0;    
-    try
-    {
-        trackTargetNode = mSceneMgr->getSceneNode(nodeName);
-        parent->setAutoTracking(true, trackTargetNode, localDirection, offset);
-    }
-    catch(Exception &e)
-    {
-        log("[DotScene] Error processing a track target! -> " + e.getFullDescription());
-        assert(false);
-    }
+    // Setup the track target (evaluated on update by constraint engine, not Ogre auto tracking)
+    if (StringUtil::BLANK != nodeName)
+        mConstraints->add(parent, mPrefix + nodeName, nodeName, localDirection, offset);
+    else
+        log("[DotScene] Error processing a track target! -> missing nodeName");
     
     // Process userdata (*)
     elem = node->FirstChildElement("userData");
@@ -1718,22 +2824,46 @@ void DotScene::processEntity(TiXmlElement* node, SceneNode* parent)
     assert(StringUtil::BLANK != mesh);
 
     TiXmlElement* elem = 0;
+    
+    // Repeated mesh/material: create through InstanceManager
+    if ((mInstancingPairs.end() != mInstancingPairs.find(mesh + "|" + material)) && (isInstanceable(node)))
+    {
+        if (mInstancedEntities.count(name))
+        {
+            log("Error: Duplicated entity " + name);
+            return;
+        }
+        
+        InstancedEntity* instanced = processInstancedEntity(node, parent, name, mesh, material);
+        if (instanced)
+        {
+            elem = node->FirstChildElement("userData");
+            while(elem)
+            {
+                processUserData<InstancedEntity>(elem, instanced, ENTITY, name);
+                elem = elem->NextSiblingElement("userData");
+            }
+            elem = node->FirstChildElement("userDataReference");
+            while (elem)
+            {
+                processUserDataReference<InstancedEntity>(elem, instanced, ENTITY, name);
+                elem = elem->NextSiblingElement("userDataReference");
+            }
+            return;
+        }
+    }
 
     // Create the entity
     Entity *entity = 0;
     try
     {
-        unsigned short src, dest;
-        
-        MeshPtr meshPtr = MeshManager::getSingleton().load(mesh, mGroup);
-//         if (!meshPtr->suggestTangentVectorBuildParams(VES_TANGENT, src, dest))
-//         {
-//             meshPtr->buildTangentVectors(VES_TANGENT, src, dest);
-//         }
+        //Stencil shadows need edge lists: build (or read from cache) at load instead of first frame
+        bool edgeList = castShadows && mSceneMgr->isShadowTechniqueStencilBased();
+        MeshPtr meshPtr = prepareMesh(mesh, false, edgeList, mLodGeneration);
 
         entity = (mSceneMgr->hasEntity(name))? 
                   mSceneMgr->getEntity(name):
-                  mSceneMgr->createEntity(name, mesh);                  
+                  mSceneMgr->createEntity(name, meshPtr);                  
         // Maintain a list of static and dynamic objects
         if(isStatic)
             mStaticEntities.push_back(name);
@@ -1747,9 +2877,11 @@ void DotScene::processEntity(TiXmlElement* node, SceneNode* parent)
         if (visibilityFlags) 
             entity->setVisibilityFlags(visibilityFlags);
         if (queryFlags) 
-            entity->setVisibilityFlags(queryFlags);
+            entity->setQueryFlags(queryFlags);
         if (renderingDistance > 0)
             entity->setRenderingDistance(renderingDistance);
+        if (mLodGeneration)
+            setLodRenderingDistance(entity, parent->_getDerivedScale());
         if (StringUtil::BLANK != renderQueue)
             entity->setRenderQueueGroup(parseRenderQueue(renderQueue));
         //
@@ -1792,18 +2924,11 @@ void DotScene::processEntity(TiXmlElement* node, SceneNode* parent)
             }
         }
        
-       // Process noteTracks (?)
-//        elem = node->FirstChildElement("noteTracks");
-//         if (elem)
-//         {
-//             elem = elem->FirstChildElement("noteTrack");
-//             while (elem)
-//             {
-//                 processNoteTrack(elem, entity);
-//                 elem = elem->NextSiblingElement();
-//             }
-//         }
-//         
+        // Process noteTracks (?)
+        elem = node->FirstChildElement("noteTracks");
+        if (elem)
+            processNoteTracks(elem, name, entity);
+        
         elem = node->FirstChildElement("customParameters");
         if (elem)
         {
@@ -1828,14 +2953,17 @@ void DotScene::processEntity(TiXmlElement* node, SceneNode* parent)
         
         if (StringUtil::BLANK != material)
         {
-            MaterialPtr materialPtr =  MaterialManager::getSingletonPtr()->getByName(material);
+            MaterialPtr materialPtr = getMaterialVariant(material, receiveShadows);
             assert(! materialPtr.isNull());
-            materialPtr.getPointer()->setReceiveShadows(receiveShadows);
             entity->setMaterial(materialPtr); 
         }
         
         log("Attaching entity " + entity->getName() + " on node " + parent->getName());  
         parent->attachObject(entity);
+        
+        //Static batching candidate (batched when all nodes are processed)
+        if ((isStatic) && (visible) && (mStaticBatching) && (! entity->hasSkeleton()))
+            mBatchedEntities.push_back(entity);
     }
     catch(Exception &e)
     {
@@ -1859,6 +2987,132 @@ void DotScene::processEntity(TiXmlElement* node, SceneNode* parent)
     }     
 }
 //----------------------------------------------------------------------------
+void DotScene::countInstancingPairs(TiXmlElement* node)
+{
+    //Entities anywhere below 'nodes' (node hierarchy)
+    for(TiXmlElement* elem=node->FirstChildElement(); elem; elem=elem->NextSiblingElement())
+    {
+        //Prefab entities are counted once per reference
+        if ("instance" == String(elem->Value()))
+        {
+            String ref = getAttrib(elem, "ref");
+            std::map<String, TiXmlElement*>::iterator it = mPrefabs.find(ref);
+            if ((mPrefabs.end() != it) && (! mActivePrefabs.count(ref)))
+            {
+                mActivePrefabs.insert(ref);
+                countInstancingPairs(it->second);
+                mActivePrefabs.erase(ref);
+            }
+            continue;
+        }
+        
+        if ("entity" != String(elem->Value()))
+        {
+            countInstancingPairs(elem);
+            continue;
+        }
+        
+        //static entities are batched instead
+        if ((mStaticBatching) && (getAttribBool(elem, "static", false)))
+            continue;
+        if (! isInstanceable(elem))
+            continue;
+        
+        String mesh = getAttrib(elem, "meshFile");
+        String material = getAttrib(elem, "materialFile");
+        if (StringUtil::BLANK == material)
+            material = getAttrib(elem, "material");
+        
+        InstancingPairType& pair = mInstancingPairs[mesh + "|" + material];
+        pair.mMesh = mesh;
+        pair.mMaterial = material;
+        pair.mCount++;
+    }
+}
+//----------------------------------------------------------------------------
+bool DotScene::isInstanceable(TiXmlElement* node)
+{
+    //Instanced entities share batch material, render queue & rendering distance
+    if ((! getAttribBool(node, "receiveShadows", true)) || 
+        (StringUtil::BLANK != getAttrib(node, "renderQueue")) ||
+        (getAttribReal(node, "renderingDistance") > 0))
+        return false;
+    
+    static const char* features[] = { "subentities", "vertexBuffer", "indexBuffer", "noteTracks", 
+                                       "customParameters", "boneAttachments" };
+    for(size_t i=0; i<sizeof(features) / sizeof(features[0]); i++)
+    {
+        if (node->FirstChildElement(features[i]))
+            return false;
+    }
+    
+    return true;
+}
+//----------------------------------------------------------------------------
+InstancedEntity* DotScene::processInstancedEntity(TiXmlElement* node, SceneNode* parent, const String& name, 
+                                                  const String& mesh, const String& material)
+{
+    InstancingPairType& pair = mInstancingPairs[mesh + "|" + material];
+    
+    //First instance: create manager (single submesh meshes only)
+    if (StringUtil::BLANK == pair.mManager)
+    {
+        MeshPtr meshPtr = prepareMesh(mesh, false, false);
+        if (meshPtr->getNumSubMeshes() != 1)
+        {
+            log("Automatic instancing: " + mesh + " has several submeshes, using entities");
+            mInstancingPairs.erase(mesh + "|" + material);
+            return 0;
+        }
+        if (StringUtil::BLANK == pair.mMaterial)
+            pair.mMaterial = meshPtr->getSubMesh(0)->getMaterialName();
+        
+        //Instancing techniques need instancing vertex shaders: "<material>/Instanced" variant
+        String instancedMaterial = pair.mMaterial + INSTANCING_MATERIAL_SUFFIX;
+        if (! MaterialManager::getSingletonPtr()->resourceExists(instancedMaterial))
+        {
+            log("Automatic instancing: no material " + instancedMaterial + " for " + mesh + ", using entities");
+            mInstancingPairs.erase(mesh + "|" + material);
+            return 0;
+        }
+        pair.mMaterial = instancedMaterial;
+        
+        //technique not supported by render system or mesh (skeletal)
+        pair.mMesh = meshPtr->getName();
+        size_t batchSize = mSceneMgr->getNumInstancesPerBatch(pair.mMesh, meshPtr->getGroup(), pair.mMaterial, 
+                                                               mInstancingTechnique, mInstancingBatchSize);
+        if (! batchSize)
+        {
+            log("Automatic instancing: technique not supported for " + mesh + ", using entities");
+            mInstancingPairs.erase(mesh + "|" + material);
+            return 0;
+        }
+        
+        pair.mManager = mPrefix + getName() + "Instancing" + stringify((int)mInstanceManagers.size());
+        mSceneMgr->createInstanceManager(pair.mManager, pair.mMesh, meshPtr->getGroup(), mInstancingTechnique, batchSize);
+        mInstanceManagers.push_back(pair.mManager);
+    }
+    
+    InstancedEntity* instanced = mSceneMgr->createInstancedEntity(pair.mMaterial, pair.mManager);
+    mInstancedEntities[name] = instanced;
+    mInstancedNames[instanced] = name;
+    
+    instanced->setCastShadows(getAttribBool(node, "castShadows", true));
+    instanced->setVisible(getAttribBool(node, "visible", true));
+    
+    int queryFlags =  getAttribInt(node, "queryFlags", mQueryFlags);
+    int visibilityFlags = getAttribInt(node, "visibilityFlags", mVisibilityFlags);
+    if (visibilityFlags) 
+        instanced->setVisibilityFlags(visibilityFlags);
+    if (queryFlags) 
+        instanced->setQueryFlags(queryFlags);
+    
+    log("Attaching instanced entity " + name + " on node " + parent->getName());  
+    parent->attachObject(instanced);
+    
+    return instanced;
+}
+//----------------------------------------------------------------------------
 void DotScene::processEntity(TiXmlElement* node, InstancedGeometry* geometry)
 {
     TRACE_FUNC();
@@ -1917,17 +3171,11 @@ void DotScene::processEntity(TiXmlElement* node, InstancedGeometry* geometry)
     Entity *entity = 0;
     try
     {
-        unsigned short src, dest;
-        
-        MeshPtr meshPtr = MeshManager::getSingleton().load(mesh, mGroup);
-        if (!meshPtr->suggestTangentVectorBuildParams(VES_TANGENT, src, dest))
-        {
-            meshPtr->buildTangentVectors(VES_TANGENT, src, dest);
-        }
+        MeshPtr meshPtr = prepareMesh(mesh, true, castShadows, mLodGeneration);
 
         entity = (mSceneMgr->hasEntity(name))? 
                   mSceneMgr->getEntity(name):
-                  mSceneMgr->createEntity(name, mesh);                  
+                  mSceneMgr->createEntity(name, meshPtr);                  
         // Maintain a list of static and dynamic objects
         if(isStatic)
             mStaticEntities.push_back(name);
@@ -1941,7 +3189,7 @@ void DotScene::processEntity(TiXmlElement* node, InstancedGeometry* geometry)
         if (visibilityFlags) 
             entity->setVisibilityFlags(visibilityFlags);
         if (queryFlags) 
-            entity->setVisibilityFlags(queryFlags);
+            entity->setQueryFlags(queryFlags);
         if (renderingDistance > 0)
             entity->setRenderingDistance(renderingDistance);
         if (StringUtil::BLANK != renderQueue)
@@ -1950,9 +3198,6 @@ void DotScene::processEntity(TiXmlElement* node, InstancedGeometry* geometry)
         
         if (StringUtil::BLANK != renderQueue)
             entity->setRenderQueueGroup(parseRenderQueue(renderQueue));
-        
-        if  (castShadows && meshPtr->isEdgeListBuilt())
-            meshPtr->buildEdgeList();
 
         // Process vertexBuffer (?)
         elem = node->FirstChildElement("vertexBuffer");
@@ -1989,12 +3234,16 @@ void DotScene::processEntity(TiXmlElement* node, InstancedGeometry* geometry)
         
         if (StringUtil::BLANK != material)
         {
-            MaterialPtr materialPtr =  MaterialManager::getSingletonPtr()->getByName(material);
+            MaterialPtr materialPtr = getMaterialVariant(material, receiveShadows);
             assert(! materialPtr.isNull());
-            materialPtr.getPointer()->setReceiveShadows(receiveShadows);
             entity->setMaterial(materialPtr); 
         }
         
+        //Geometries are attached to scene manager root: apply scene root transform
+        position = mSceneRoot->convertLocalToWorldPosition(position);
+        orientation = mSceneRoot->convertLocalToWorldOrientation(orientation);
+        scale = mSceneRoot->_getDerivedScale() * scale;
+        
         log("Attaching entity " + entity->getName() + " on geometry " + geometry->getName());  
         geometry->addEntity(entity, position, orientation, scale);
     }
@@ -2078,17 +3327,11 @@ void DotScene::processEntity(TiXmlElement* node, StaticGeometry* geometry)
     Entity *entity = 0;
     try
     {
-        unsigned short src, dest;
-        
-        MeshPtr meshPtr = MeshManager::getSingleton().load(mesh, mGroup);
-        if (!meshPtr->suggestTangentVectorBuildParams(VES_TANGENT, src, dest))
-        {
-            meshPtr->buildTangentVectors(VES_TANGENT, src, dest);
-        }
+        MeshPtr meshPtr = prepareMesh(mesh, true, castShadows, mLodGeneration);
 
         entity = (mSceneMgr->hasEntity(name))? 
                   mSceneMgr->getEntity(name):
-                  mSceneMgr->createEntity(name, mesh);                  
+                  mSceneMgr->createEntity(name, meshPtr);                  
         // Maintain a list of static and dynamic objects
         if(isStatic)
             mStaticEntities.push_back(name);
@@ -2102,7 +3345,7 @@ void DotScene::processEntity(TiXmlElement* node, StaticGeometry* geometry)
         if (visibilityFlags) 
             entity->setVisibilityFlags(visibilityFlags);
         if (queryFlags) 
-            entity->setVisibilityFlags(queryFlags);
+            entity->setQueryFlags(queryFlags);
         if (renderingDistance > 0)
             entity->setRenderingDistance(renderingDistance);
         if (StringUtil::BLANK != renderQueue)
@@ -2111,9 +3354,6 @@ void DotScene::processEntity(TiXmlElement* node, StaticGeometry* geometry)
         
         if (StringUtil::BLANK != renderQueue)
             entity->setRenderQueueGroup(parseRenderQueue(renderQueue));
-        
-        if  (castShadows && meshPtr->isEdgeListBuilt())
-            meshPtr->buildEdgeList();
 
         // Process vertexBuffer (?)
         elem = node->FirstChildElement("vertexBuffer");
@@ -2151,12 +3391,16 @@ void DotScene::processEntity(TiXmlElement* node, StaticGeometry* geometry)
         
         if (StringUtil::BLANK != material)
         {
-            MaterialPtr materialPtr =  MaterialManager::getSingletonPtr()->getByName(material);
+            MaterialPtr materialPtr = getMaterialVariant(material, receiveShadows);
             assert(! materialPtr.isNull());
-            materialPtr.getPointer()->setReceiveShadows(receiveShadows);
             entity->setMaterial(materialPtr); 
         }
         
+        //Geometries are attached to scene manager root: apply scene root transform
+        position = mSceneRoot->convertLocalToWorldPosition(position);
+        orientation = mSceneRoot->convertLocalToWorldOrientation(orientation);
+        scale = mSceneRoot->_getDerivedScale() * scale;
+        
         log("Attaching entity " + entity->getName() + " on geometry " + geometry->getName());  
         geometry->addEntity(entity, position, orientation, scale);
     }
@@ -2223,10 +3467,11 @@ void DotScene::processParticleSystem(TiXmlElement* node, SceneNode* parent)
     ParticleSystem* particlessystem = 0;
     try
     {
-        ParticleSystem* particlessystem = (mSceneMgr->hasParticleSystem(name))? 
-                                                 mSceneMgr->getParticleSystem(name) 
-                                                :mSceneMgr->createParticleSystem(name, file);
+        particlessystem = (mSceneMgr->hasParticleSystem(name))? 
+                                 mSceneMgr->getParticleSystem(name) 
+                                :mSceneMgr->createParticleSystem(name, file);
         mParticleSystem.push_back(name);
+        mParticleTemplates.push_back(file);
         
         //Set particlessystem settings
         particlessystem->setVisible(visible);
@@ -2236,9 +3481,9 @@ void DotScene::processParticleSystem(TiXmlElement* node, SceneNode* parent)
         if (queryFlags) 
             particlessystem->setQueryFlags(queryFlags);
         
-        String materialName = particlessystem->getMaterialName();
-        MaterialPtr materialPtr =  MaterialManager::getSingletonPtr()->getByName(materialName);
-        materialPtr.getPointer()->setReceiveShadows(receiveShadows);
+        MaterialPtr materialPtr = getMaterialVariant(particlessystem->getMaterialName(), receiveShadows);
+        if (! materialPtr.isNull())
+            particlessystem->setMaterialName(materialPtr->getName(), materialPtr->getGroup());
         
         parent->attachObject(particlessystem);
     }
@@ -2251,9 +3496,9 @@ void DotScene::processParticleSystem(TiXmlElement* node, SceneNode* parent)
     TiXmlElement* elem = 0;
     
     // Process noteTracks (?)
-//     elem = node->FirstChildElement("noteTracks");
-//     if (elem)
-//         processNoteTrack(elem);
+    elem = node->FirstChildElement("noteTracks");
+    if (elem)
+        processNoteTracks(elem, name);
     
      // Process userdata (*)
     elem = node->FirstChildElement("userData");
@@ -2379,7 +3624,7 @@ void DotScene::processBillboardSet(TiXmlElement* node, SceneNode* parent)
     if (visibilityFlags) 
         billboardSet->setVisibilityFlags(visibilityFlags);
     if (queryFlags) 
-        billboardSet->setVisibilityFlags(queryFlags);
+        billboardSet->setQueryFlags(queryFlags);
     if (renderingDistance > 0)
         billboardSet->setRenderingDistance(renderingDistance);
     if (StringUtil::BLANK != renderQueue)
@@ -2426,9 +3671,9 @@ void DotScene::processBillboardSet(TiXmlElement* node, SceneNode* parent)
     }
     
     // Process noteTracks (?)
-//     elem = node->FirstChildElement("noteTracks");
-//     if (elem)
-//         processNoteTrack(elem);
+    elem = node->FirstChildElement("noteTracks");
+    if (elem)
+        processNoteTracks(elem, name);
     
     // Process userdata (*)
     elem = node->FirstChildElement("userData");
@@ -2492,7 +3737,7 @@ void DotScene::processPlane(TiXmlElement* node, SceneNode* parent)
     MeshPtr planePtr = MeshManager::getSingletonPtr()->getByName(name);
     if (planePtr.isNull())
     {
-        MeshPtr planePtr = MeshManager::getSingletonPtr()->createPlane(
+        planePtr = MeshManager::getSingletonPtr()->createPlane(
             name, mGroup,
             Plane(normal, -1), width, height, 
             xSegments, ySegments, buildNormals, 
@@ -2530,7 +3775,7 @@ void DotScene::processPlane(TiXmlElement* node, SceneNode* parent)
         if (visibilityFlags) 
             entity->setVisibilityFlags(visibilityFlags);
         if (queryFlags) 
-            entity->setVisibilityFlags(queryFlags);
+            entity->setQueryFlags(queryFlags);
         if (renderingDistance > 0)
             entity->setRenderingDistance(renderingDistance);
         if (StringUtil::BLANK != renderQueue)
@@ -2538,9 +3783,8 @@ void DotScene::processPlane(TiXmlElement* node, SceneNode* parent)
         
         if (StringUtil::BLANK != material)
         {
-            MaterialPtr materialPtr =  MaterialManager::getSingletonPtr()->getByName(material);
+            MaterialPtr materialPtr = getMaterialVariant(material, receiveShadows);
             assert(! materialPtr.isNull());
-            materialPtr.getPointer()->setReceiveShadows(receiveShadows);
             entity->setMaterial(materialPtr); 
         }
         
@@ -2552,7 +3796,9 @@ void DotScene::processPlane(TiXmlElement* node, SceneNode* parent)
         
         if (createMovablePlane)
         {
-            MovablePlane* movablePlane = new MovablePlane(name + "MovablePlane");
+            MovablePlane* movablePlane = mArena->track(
+                new (mArena->allocate(sizeof(MovablePlane))) MovablePlane(name + "MovablePlane"));
+            mMovablePlanes.push_back(movablePlane);
             movablePlane->normal = normal;
             movablePlane->d = distance;
             parent->attachObject(movablePlane);
@@ -2563,17 +3809,16 @@ void DotScene::processPlane(TiXmlElement* node, SceneNode* parent)
         Entity* planeEntity = mSceneMgr->getEntity(name + "Entity");
         if (StringUtil::BLANK != material)
         {
-            MaterialPtr materialPtr =  MaterialManager::getSingletonPtr()->getByName(material);
+            MaterialPtr materialPtr = getMaterialVariant(material, receiveShadows);
             assert(! materialPtr.isNull());
-            materialPtr.getPointer()->setReceiveShadows(receiveShadows);
             planeEntity->setMaterial(materialPtr); 
         }
     }
     
     // Process noteTracks (?)
-//     elem = node->FirstChildElement("noteTracks");
-//     if (elem)
-//         processNoteTrack(elem);
+    elem = node->FirstChildElement("noteTracks");
+    if (elem)
+        processNoteTracks(elem, name);
     
     // Process userdata (*)
     elem = node->FirstChildElement("userData");
@@ -2954,38 +4199,43 @@ void DotScene::processShadowCameraSetup(TiXmlElement* node)
     }
     else if (_setup == "uniformfocused")
     {
-        FocusedShadowCameraSetup* setup = new FocusedShadowCameraSetup();
-        setup->setUseAggressiveFocusRegion(getAttribBool(node, "useAggressiveFocusRegion", true));
+        FocusedShadowCameraSetup* focused = new FocusedShadowCameraSetup();
+        focused->setUseAggressiveFocusRegion(getAttribBool(node, "useAggressiveFocusRegion", true));
+        setup = focused;
     }
     else if (_setup == "lispsm")
     {
-        LiSPSMShadowCameraSetup* setup = new LiSPSMShadowCameraSetup;
-        setup->setUseAggressiveFocusRegion(getAttribBool(node, "useAggressiveFocusRegion", true));
-        setup->setUseSimpleOptimalAdjust(getAttribBool(node, "useSimpleOptimalAdjust", true));
+        LiSPSMShadowCameraSetup* lispsm = new LiSPSMShadowCameraSetup;
+        lispsm->setUseAggressiveFocusRegion(getAttribBool(node, "useAggressiveFocusRegion", true));
+        lispsm->setUseSimpleOptimalAdjust(getAttribBool(node, "useSimpleOptimalAdjust", true));
         
         float optimalAdjustFactor = 0;
-        if (! setup->getUseSimpleOptimalAdjust())
+        if (! lispsm->getUseSimpleOptimalAdjust())
             optimalAdjustFactor = getAttribReal(node, "optimalAdjustFactor", 0.1f);
-        setup->setOptimalAdjustFactor(optimalAdjustFactor);
+        lispsm->setOptimalAdjustFactor(optimalAdjustFactor);
         
-        setup->setCameraLightDirectionThreshold(Radian(getAttribReal(node, "lightDirectionThreshold",0.45102624)));
+        lispsm->setCameraLightDirectionThreshold(Radian(getAttribReal(node, "lightDirectionThreshold",0.45102624)));
+        setup = lispsm;
     }
     else if (_setup == "pssm")
     {
-        PSSMShadowCameraSetup* setup = new PSSMShadowCameraSetup;
-        setup->setUseAggressiveFocusRegion(getAttribBool(node, "useAggressiveFocusRegion", true));
-        setup->calculateSplitPoints(
+        PSSMShadowCameraSetup* pssm = new PSSMShadowCameraSetup;
+        pssm->setUseAggressiveFocusRegion(getAttribBool(node, "useAggressiveFocusRegion", true));
+        pssm->calculateSplitPoints(
             getAttribInt(node, "splitCount", 3),
             getAttribReal(node, "splitNearDistance", 100.0f),
             getAttribReal(node, "splitFarDistance", 100000.0f),
             getAttribReal(node, "splitReduction", 0.95f));
         
-        setup->setSplitPadding(getAttribReal(node, "splitPadding", 1.0));
+        pssm->setSplitPadding(getAttribReal(node, "splitPadding", 1.0));
+        setup = pssm;
     }
     else if (_setup == "planeoptimal")
     {
-        //The plane optimal setup requires a plane.
-        MovablePlane* plane = new MovablePlane("_shadowOptimalPlane");
+        //The plane optimal setup requires a plane (alive until the setup is uninstalled)
+        MovablePlane* plane = mArena->track(
+            new (mArena->allocate(sizeof(MovablePlane))) MovablePlane(mPrefix + mName + "ShadowOptimalPlane"));
+        mMovablePlanes.push_back(plane);
 
         Vector3  up = getUpVector();
         plane->normal.x = getAttribReal(node, "planeX", up.x);
@@ -2999,10 +4249,13 @@ void DotScene::processShadowCameraSetup(TiXmlElement* node)
     {
         log("Error: Invalid shadow camera setup");
         assert(false);
+        return;
     }
     
+    //shared pointer owns the setup
     ptr = ShadowCameraSetupPtr(setup);
     mSceneMgr->setShadowCameraSetup(ptr);
+    mShadowCameraSetup = ptr;
 }
 //---------------------------------------------------------------------------
 void DotScene::processRenderTextures(TiXmlElement* node)
@@ -3101,27 +4354,29 @@ void DotScene::processRenderTextures(TiXmlElement* node)
 void DotScene::processInstancedGeometries(TiXmlElement* node)
 {
     TRACE_FUNC();
-    assert(false);
     
     //Ensure instancing is supported
     Root* root = Root::getSingletonPtr();
     bool supported = root->getRenderSystem()->getCapabilities()->hasCapability(RSC_VERTEX_PROGRAM);
-    assert(supported);
+    if (! supported)
+    {
+        log("[DotScene] Instanced geometries ignored: vertex programs not supported");
+        return;
+    }
 
     //Read all the instanced geometries
     TiXmlElement* elem = 0;
     elem = node->FirstChildElement("instancedGeometry");
     while(elem)
     {
-        
-        String name = getAttrib(elem, "name");
+        String name = mPrefix + getAttrib(elem, "name");
         bool castShadows = getAttribBool(elem, "castShadows", true);
-        bool visible = getAttribBool(elem, "visible");
+        bool visible = getAttribBool(elem, "visible", true);
         unsigned int batchCount = getAttribInt(elem, "batchCount", 0);
+        int visibilityFlags = getAttribInt(elem, "visibilityFlags", 0);
         
         String queue = getAttrib(elem, "renderQueue");
         Real distance = getAttribReal(elem, "renderingDistance", 0);
-    
         
         TiXmlElement* child = 0; 
         
@@ -3130,18 +4385,21 @@ void DotScene::processInstancedGeometries(TiXmlElement* node)
         if (child)
             origin = parseVector3(child);
         
-        
         Vector3 dimension = Vector3(1000000, 1000000, 1000000);
         child = elem->FirstChildElement("dimensions");
         if (child)
             dimension = parseVector3(child);
         
         InstancedGeometry* geometry = mSceneMgr->createInstancedGeometry(name);
+        mInstancedGeometries.push_back(name);
+        if (! visible)
+            mHiddenGeometries.insert(name);
+        
         geometry->setCastShadows(castShadows);
-        geometry->setVisible(visible);
         geometry->setOrigin(origin);
         geometry->setBatchInstanceDimensions(dimension);
-        
+        if (visibilityFlags)
+            geometry->setVisibilityFlags(visibilityFlags);
         if (StringUtil::BLANK != queue)
             geometry->setRenderQueueGroup(parseRenderQueue(queue));
         geometry->setRenderingDistance(distance);
@@ -3154,30 +4412,35 @@ void DotScene::processInstancedGeometries(TiXmlElement* node)
             while (child)
             {
                 processEntity(child, geometry);
-                child =  child->NextSiblingElement();
+                child = child->NextSiblingElement("entity");
             }
         }
         
-        //Build the instanced geometry
+        //Build once with all its entities (Ogre 1.8 creates hardware buffers: main thread)
         geometry->build();
+        for(unsigned int i=0; i<batchCount; i++)
+            geometry->addBatchInstance();
+        geometry->setVisible(visible && getVisible());
+        
+        elem = elem->NextSiblingElement("instancedGeometry");
     }
 }
 //---------------------------------------------------------------------------
 void DotScene::processStaticGeometries(TiXmlElement* node)
 {
     TRACE_FUNC();
-    assert(false);
     
     TiXmlElement* elem = 0;
     
     elem = node->FirstChildElement("staticGeometry");
     while (elem)
     {
-        String name = getAttrib(node, "name");
-        bool castShadows = getAttribBool(node, "castShadows", true);
-        bool visible = getAttribBool(node, "visible", true);
-        String queue = getAttrib(node, "renderQueue");
-        Real distance = getAttribReal(node, "renderingDistance");
+        String name = mPrefix + getAttrib(elem, "name");
+        bool castShadows = getAttribBool(elem, "castShadows", true);
+        bool visible = getAttribBool(elem, "visible", true);
+        int visibilityFlags = getAttribInt(elem, "visibilityFlags", 0);
+        String queue = getAttrib(elem, "renderQueue");
+        Real distance = getAttribReal(elem, "renderingDistance");
         
         TiXmlElement* child = 0;
 
@@ -3191,13 +4454,18 @@ void DotScene::processStaticGeometries(TiXmlElement* node)
         if (child)
             dimension = parseVector3(child);
         
-        //Create the instanced geometry
+        //Create the static geometry
         StaticGeometry* geometry = mSceneMgr->createStaticGeometry(name);
+        mStaticGeometries.push_back(name);
+        if (! visible)
+            mHiddenGeometries.insert(name);
+        
         geometry->setCastShadows(castShadows);
-        geometry->setVisible(visible);
         geometry->setOrigin(origin);
         geometry->setRegionDimensions(dimension);
         geometry->setRenderingDistance(distance);
+        if (visibilityFlags)
+            geometry->setVisibilityFlags(visibilityFlags);
         if (StringUtil::BLANK != queue)
             geometry->setRenderQueueGroup(parseRenderQueue(queue));
 
@@ -3208,11 +4476,15 @@ void DotScene::processStaticGeometries(TiXmlElement* node)
             while (child)
             {
                 processEntity(child, geometry);
-                child =  child->NextSiblingElement();
+                child = child->NextSiblingElement("entity");
             }
         }
         
-        elem = elem->NextSiblingElement();
+        //Build once with all its entities (Ogre 1.8 creates hardware buffers: main thread)
+        geometry->build();
+        geometry->setVisible(visible && getVisible());
+        
+        elem = elem->NextSiblingElement("staticGeometry");
     }
 }
 //---------------------------------------------------------------------------
@@ -3222,24 +4494,55 @@ void DotScene::processPortalConnectedZones(TiXmlElement* node)
     assert(false);
 }
 //---------------------------------------------------------------------------
-void DotScene::processNoteTrack(TiXmlElement* node, SceneNode* parent)
+void DotScene::processNoteTracks(TiXmlElement* node, const String& object, Entity* entity/*=0*/)
 {
     TRACE_FUNC();
-    assert(false);
     assert(node);
-    assert(parent);
     
-    //<noteTrack name="string"><note time="Real">Text</note></noteTrack>
+    TiXmlElement* elem = node->FirstChildElement("noteTrack");
+    while (elem)
+    {
+        processNoteTrack(elem, object, entity);
+        elem = elem->NextSiblingElement("noteTrack");
+    }
 }
 //---------------------------------------------------------------------------
-void DotScene::processNoteTrack(TiXmlElement* node, Entity* entity)
+void DotScene::processNoteTrack(TiXmlElement* node, const String& object, Entity* entity)
 {
     TRACE_FUNC();
-    assert(false);
     assert(node);
-    assert(entity);
     
     //<noteTrack name="string"><note time="Real">Text</note></noteTrack>
+    NoteTrackType track;
+    track.mObject = object;
+    track.mName = getAttrib(node, "name");
+    track.mEntity = entity;
+    track.mState = 0;
+    track.mLast = -1;
+    track.mCursor = 0;
+    
+    TiXmlElement* elem = node->FirstChildElement("note");
+    while (elem)
+    {
+        NoteType note;
+        note.mTime = getAttribReal(elem, "time");
+        note.mText = (elem->GetText())? elem->GetText(): StringUtil::BLANK;
+        track.mNotes.push_back(note);
+        
+        elem = elem->NextSiblingElement("note");
+    }
+    
+    if (track.mNotes.empty())
+        return;
+    
+    //Timeline sorted by time (notes at same time keep file order)
+    std::stable_sort(track.mNotes.begin(), track.mNotes.end(), &DotScene::noteLess);
+    mNoteTracks.push_back(track);
+}
+//---------------------------------------------------------------------------
+bool DotScene::noteLess(const NoteType& a, const NoteType& b)
+{
+    return a.mTime < b.mTime;
 }
 //---------------------------------------------------------------------------
 void DotScene::processCustomParameter(TiXmlElement* node, Entity* entity)
@@ -3410,9 +4713,9 @@ void DotScene::processIndexBuffer(TiXmlElement* node, HardwareIndexBuffer::Usage
 void DotScene::processAnimation(TiXmlElement* node, SceneNode* parent)
 {
     TRACE_FUNC();
-    assert(false);
+    assert(parent);
     
-    String name = getAttrib(node, "name");
+    String name = mPrefix + getAttrib(node, "name");
     Real length = getAttribReal(node, "length");
     
     String _interpolationMode = getAttrib(node, "interpolationMode");
@@ -3425,62 +4728,71 @@ void DotScene::processAnimation(TiXmlElement* node, SceneNode* parent)
     //Rotation interpolation mode
     String _rotationInterpolationMode = getAttrib(node, "rotationInterpolationMode");
     Animation::RotationInterpolationMode rotationInterpolationMode = Animation::RIM_LINEAR;
-    if (_interpolationMode == "linear")
+    if (_rotationInterpolationMode == "linear")
         rotationInterpolationMode = Animation::RIM_LINEAR;
-    else if (_interpolationMode == "spherical")
+    else if (_rotationInterpolationMode == "spherical")
         rotationInterpolationMode = Animation::RIM_SPHERICAL;
 
     bool enable = getAttribBool(node, "enable", true);
     bool looping = getAttribBool(node, "loop", true);
+    
+    if (mSceneMgr->hasAnimation(name))
+    {
+        log("Error: Duplicated animation " + name);
+        return;
+    }
+    
+    //Node track: keyframes relative to node initial state (applied by scene manager on render)
+    Animation* animation = mSceneMgr->createAnimation(name, length);
+    animation->setInterpolationMode(interpolationMode);
+    animation->setRotationInterpolationMode(rotationInterpolationMode);
+    NodeAnimationTrack* track = animation->createNodeTrack(0, parent);
 
     //Load animation keyframes
     TiXmlElement* elem = 0;
     elem = node->FirstChildElement("keyframe");
     while (elem)
     {
-        processAnimationKeyFrame(elem, parent);
-        elem = elem->NextSiblingElement();
+        processAnimationKeyFrame(elem, track);
+        elem = elem->NextSiblingElement("keyframe");
     }
+    
+    //Merge duplicated keys & build keyframe time list now (not on first sample)
+    animation->optimise(false);
+    animation->_getTimeIndex(0);
+    
+    AnimationState* state = mSceneMgr->createAnimationState(name);
+    state->setEnabled(enable);
+    state->setLoop(looping);
+    mAnimationStates.push_back(state);
 }
 //----------------------------------------------------------------------------
-void DotScene::processAnimationKeyFrame(TiXmlElement* node, SceneNode* parent)
+void DotScene::processAnimationKeyFrame(TiXmlElement* node, NodeAnimationTrack* track)
 {
     TRACE_FUNC();
-    assert(false);
+    assert(track);
     
     //Key time
     Real time = getAttribReal(node, "time");
-
-    Vector3 translation = Vector3::ZERO; 
-    Quaternion rotation = Quaternion::IDENTITY;
-    Vector3 scale = Vector3::UNIT_SCALE; 
+    TransformKeyFrame* keyFrame = track->createNodeKeyFrame(time);
     
-    TiXmlElement* child =0, *elem = 0;
-    elem = node->FirstChildElement("keyframe");
-    while (elem)
-    {
-        translation = Vector3::ZERO; 
-        rotation = Quaternion::IDENTITY;
-        scale = Vector3::UNIT_SCALE; 
-        
-        child = elem->FirstChildElement("translation");  
-        if (child)
-            translation = parseVector3(child);
-        
-        child = elem->FirstChildElement("rotation");  
-        if (child)
-            rotation = parseQuaternion(child);
-        
-        child = elem->FirstChildElement("scale");  
-        if (child)
-            scale = parseVector3(child);
-        
-        elem = elem->FirstChildElement();
-    }
+    TiXmlElement* elem = 0;
+    elem = node->FirstChildElement("translation");  
+    if (elem)
+        keyFrame->setTranslate(parseVector3(elem));
+    
+    elem = node->FirstChildElement("rotation");  
+    if (elem)
+        keyFrame->setRotation(parseQuaternion(elem));
+    
+    elem = node->FirstChildElement("scale");  
+    if (elem)
+        keyFrame->setScale(parseVector3(elem));
 }
 //----------------------------------------------------------------------------
 template <typename T>
-void DotScene::processUserData(TiXmlElement* node, T* reference, NodePropertyType type)
+void DotScene::processUserData(TiXmlElement* node, T* reference, NodePropertyType type, 
+                               const String& referenceName/*=BLANK*/)
 {
     TRACE_FUNC();
     assert(node);
@@ -3503,7 +4815,7 @@ void DotScene::processUserData(TiXmlElement* node, T* reference, NodePropertyTyp
             if(StringUtil::BLANK == value) 
                 value = name;
             
-            addProperty<T>(reference, name, value, type);
+            addProperty<T>(reference, name, value, type, referenceName);
             
             elem = elem->NextSiblingElement("property");
         }
@@ -3517,12 +4829,13 @@ void DotScene::processUserData(TiXmlElement* node, T* reference, NodePropertyTyp
         if(StringUtil::BLANK == value) 
             value = name;
 
-        addProperty<T>(reference, name, value, type);
+        addProperty<T>(reference, name, value, type, referenceName);
     }
 }
 //----------------------------------------------------------------------------
 template <typename T>
-void DotScene::processUserDataReference(TiXmlElement* node, T* reference, NodePropertyType type)
+void DotScene::processUserDataReference(TiXmlElement* node, T* reference, NodePropertyType type, 
+                                        const String& referenceName/*=BLANK*/)
 {
     TRACE_FUNC();
     
@@ -3531,16 +4844,15 @@ void DotScene::processUserDataReference(TiXmlElement* node, T* reference, NodePr
     if(StringUtil::BLANK == value) 
         value = name;
     
-    addProperty<T>(reference, name, value, type);
+    addProperty<T>(reference, name, value, type, referenceName);
 }
 //----------------------------------------------------------------------------
 template<typename T>
-void DotScene::addProperty(T* reference, const  String& name, const String& value, NodePropertyType type)
+void DotScene::addProperty(T* reference, const  String& name, const String& value, NodePropertyType type, 
+                           const String& referenceName/*=BLANK*/)
 {
     printf("Property (%s, %s, %s, %i)\n", reference->getName().c_str(), name.c_str(), value.c_str(), type);
     
-    SceneNodeProperty<T>* property = 0;
-    
     //special case boolean properties 'isxxx', 'isnotxxx'
     String str = name;
     boost::to_lower(str);
@@ -3550,35 +4862,49 @@ void DotScene::addProperty(T* reference, const  String& name, const String& valu
     {
         boost::algorithm::replace_first(str, "isnot", StringUtil::BLANK);
         boost::algorithm::to_lower(str);
-        property = new SceneNodeProperty<T>(reference, str, "false", type);
-        mProperties.push_back(property);
+        createProperty<T>(reference, str, "false", type, referenceName);
     }
     else if (boost::algorithm::starts_with(str, "is"))
     {
         boost::algorithm::replace_first(str, "is", StringUtil::BLANK);
         boost::algorithm::to_lower(str);
-        property = new SceneNodeProperty<T>(reference, str, "true", type);
-        mProperties.push_back(property);
+        createProperty<T>(reference, str, "true", type, referenceName);
     }
     else
     {
-        property = new SceneNodeProperty<T>(reference, name, value, type);
-        mProperties.push_back(property);
+        createProperty<T>(reference, name, value, type, referenceName);
     }
 }
 //----------------------------------------------------------------------------
 template<typename T>
+NodeProperty* DotScene::createProperty(T* reference, const DotSceneString& name, const DotSceneString& value, NodePropertyType type, 
+                                       const String& referenceName/*=BLANK*/)
+{
+    void* memory = mArena->allocate(sizeof(SceneNodeProperty<T>));
+    SceneNodeProperty<T>* property = mArena->track((StringUtil::BLANK == referenceName)? 
+        new (memory) SceneNodeProperty<T>(reference, name, value, type):
+        new (memory) SceneNodeProperty<T>(reference, referenceName, name, value, type));
+    mProperties.push_back(property);
+    
+    return property;
+}
+//----------------------------------------------------------------------------
+template<typename T>
 const PropertyList& DotScene::findObjectByProperty(NodePropertyType type, const String& name, const String& value/*=BLANK*/)
 {
     static PropertyList lst; 
     
     lst.clear();
+    DotSceneString _name, _value;
+    if ((! DotSceneString::find(name, _name)) || (! DotSceneString::find(value, _value)))
+        return lst;
+    
     for(PropertyListIterator it=mProperties.begin(); it!=mProperties.end(); it++)
     {
         SceneNodeProperty<T> *prop = *it;
-        if ((prop->mType == type) && (prop->mName == name))
+        if ((prop->mType == type) && (prop->mName == _name))
         {
-            if ((value == StringUtil::BLANK) || (prop->mValue == value))
+            if ((value == StringUtil::BLANK) || (prop->mValue == _value))
                 lst.push_back(prop); 
         }
     }
@@ -3610,10 +4936,14 @@ const PropertyList& DotScene::getObjectProperties(const String& name)
     static PropertyList lst; 
     
     lst.clear();
+    DotSceneString _name;
+    if (! DotSceneString::find(name, _name))
+        return lst;
+    
     for(PropertyListIterator it=mProperties.begin(); it!=mProperties.end(); it++)
     {
         SceneNodeProperty<T> *prop = *it;
-        if (prop->mName == name)
+        if (prop->mName == _name)
             lst.push_back(prop); 
     }
         
@@ -3841,7 +5171,6 @@ int DotScene::parseRenderQueue(String& queue)
 int DotScene::parseQueryFlags(TiXmlElement* node)
 {
     TRACE_FUNC();
-    assert(false);
    
     int flags = 0;
     
@@ -3853,7 +5182,7 @@ int DotScene::parseQueryFlags(TiXmlElement* node)
         String name = getAttrib(elem, "name");
         int flag = getAttribInt(elem, "bit");
         flags |= flag;
-        elem = elem->NextSiblingElement();
+        elem = elem->NextSiblingElement("queryFlag");
     }
     
     return flags;
@@ -3862,19 +5191,22 @@ int DotScene::parseQueryFlags(TiXmlElement* node)
 int DotScene::parseVisibilityFlags(TiXmlElement* node)
 {
     TRACE_FUNC();
-    assert(false);
    
     int flags = 0;
     
     TiXmlElement* elem = 0;
     
+    //<visibilityFlag name="layer" bit="flags" default="bool"/>: named layer, default objects flags
     elem = node->FirstChildElement("visibilityFlag");
     while(elem)
     {
         String name = getAttrib(elem, "name");
         int flag = getAttribInt(elem, "bit");
-        flags |= flag;
-        elem = elem->NextSiblingElement();
+        if (StringUtil::BLANK != name)
+            mLayers[name] = static_cast<DotSceneManager*>(mCreator)->_registerLayer(name, flag);
+        if (getAttribBool(elem, "default", false))
+            flags |= flag;
+        elem = elem->NextSiblingElement("visibilityFlag");
     }
     
     return flags;
@@ -3951,37 +5283,230 @@ Radian DotScene::parseAngleUnit(Real value)
 //----------------------------------------------------------------------------
 SceneNode* DotScene::getSceneNode(const String& sceneNode)
 {
-    for(StringVector::iterator it=mSceneNodes.begin(); it!=mSceneNodes.end(); it++)
+    //strings never interned can't name an object in scene
+    const DotSceneStringEntry* name = DotSceneString::find(sceneNode);
+    if (! name)
+        return 0;
+    
+    for(DotSceneStringVector::iterator it=mSceneNodes.begin(); it!=mSceneNodes.end(); it++)
     {
-        if (sceneNode == *it) 
+        if (*it == name) 
             return mSceneMgr->getSceneNode(sceneNode);
     }
     
     return 0;
 }
 //----------------------------------------------------------------------------
+DotScene::NodeHandle DotScene::getNodeHandle(const String& sceneNode)
+{
+    SceneNode* node = getSceneNode(sceneNode);
+    if (! node)
+        node = getSceneNode(mPrefix + sceneNode);
+    if (! node)
+        return DOTSCENE_INVALID_HANDLE;
+    
+    std::map<const Node*, uint32>::iterator it = mHandleIndex.find(node);
+    if (mHandleIndex.end() != it)
+        return (mHandleGeneration << HANDLE_INDEX_BITS) | it->second;
+    
+    //Destroyed nodes invalidate their handle through scene node listener
+    if (static_cast<Node::Listener*>(mBounds) != node->getListener())
+        mBounds->track(node);
+    if (static_cast<Node::Listener*>(mBounds) != node->getListener())
+        log("Warning: Node " + sceneNode + " has its own listener, its handle can't detect node destruction");
+    
+    if (mHandleNodes.size() >= HANDLE_INDEX_MASK)
+    {
+        log("Error: Too many node handles");
+        return DOTSCENE_INVALID_HANDLE;
+    }
+    
+    uint32 index = (uint32)mHandleNodes.size();
+    mHandleNodes.push_back(node);
+    mHandleIndex[node] = index;
+    
+    return (mHandleGeneration << HANDLE_INDEX_BITS) | index;
+}
+//----------------------------------------------------------------------------
+void DotScene::getNodeHandles(const StringVector& sceneNodes, std::vector<NodeHandle>& handles)
+{
+    handles.resize(sceneNodes.size());
+    for(size_t i=0; i<sceneNodes.size(); i++)
+        handles[i] = getNodeHandle(sceneNodes[i]);
+}
+//----------------------------------------------------------------------------
+SceneNode* DotScene::getSceneNode(NodeHandle handle)
+{
+    uint32 index = handle & HANDLE_INDEX_MASK;
+    if (((handle >> HANDLE_INDEX_BITS) != mHandleGeneration) || (index >= mHandleNodes.size()))
+        return 0;
+    
+    return mHandleNodes[index];
+}
+//----------------------------------------------------------------------------
+void DotScene::_notifyNodeDestroyed(const Node* node)
+{
+    //Slot kept (null): handles of destroyed node are stale
+    std::map<const Node*, uint32>::iterator it = mHandleIndex.find(node);
+    if (mHandleIndex.end() == it)
+        return;
+    
+    //Snapshot nodes come from handles
+    mSnapshot->removeNode(it->second);
+    mHandleNodes[it->second] = 0;
+    mHandleIndex.erase(it);
+}
+//----------------------------------------------------------------------------
+size_t DotScene::applyTransforms(const NodeTransform* transforms, size_t count)
+{
+    assert(transforms || (! count));
+    
+    //Handles checked inline: no lookups, unchanged components don't dirty nodes
+    size_t applied = 0;
+    uint32 generation = mHandleGeneration;
+    size_t size = mHandleNodes.size();
+    SceneNode** nodes = (size)? &mHandleNodes[0]: 0;
+    for(const NodeTransform* it=transforms; it!=transforms + count; it++)
+    {
+        uint32 index = it->mHandle & HANDLE_INDEX_MASK;
+        if (((it->mHandle >> HANDLE_INDEX_BITS) != generation) || (index >= size))
+            continue;
+        
+        SceneNode* node = nodes[index];
+        if (! node)
+            continue;
+        if (node->getPosition() != it->mPosition)
+            node->setPosition(it->mPosition);
+        if (node->getOrientation() != it->mOrientation)
+            node->setOrientation(it->mOrientation);
+        if (node->getScale() != it->mScale)
+            node->setScale(it->mScale);
+        applied++;
+    }
+    
+    //Stale handles are expected after node destruction: caller checks returned count
+    return applied;
+}
+//----------------------------------------------------------------------------
+void DotScene::setSnapshotNodes(const std::vector<NodeHandle>& handles)
+{
+    if (handles.empty())
+    {
+        mSnapshot->clear();
+        return;
+    }
+    
+    std::vector<SceneNode*> nodes(handles.size());
+    std::vector<uint32> keys(handles.size(), HANDLE_INDEX_MASK);
+    for(size_t i=0; i<handles.size(); i++)
+    {
+        nodes[i] = getSceneNode(handles[i]);
+        if (nodes[i])
+            keys[i] = handles[i] & HANDLE_INDEX_MASK;
+    }
+    
+    mSnapshot->setNodes(mSceneMgr, nodes, keys);
+}
+//----------------------------------------------------------------------------
+void DotScene::publishSnapshot()
+{
+    mSnapshot->publish(Root::getSingletonPtr()->getNextFrameNumber());
+}
+//----------------------------------------------------------------------------
+bool DotScene::readSnapshot(std::vector<Vector3>& positions, std::vector<Quaternion>& orientations, 
+                            unsigned long* frame/*=0*/) const
+{
+    return mSnapshot->read(positions, orientations, frame);
+}
+//----------------------------------------------------------------------------
+unsigned long DotScene::getSnapshotFrame() const
+{
+    return mSnapshot->getFrame();
+}
+//----------------------------------------------------------------------------
 Entity* DotScene::getEntity(const String& entity)
 {
-    for(StringVector::iterator it=mDynamicEntities.begin(); it!=mDynamicEntities.end(); it++)
+    //strings never interned can't name an object in scene
+    const DotSceneStringEntry* name = DotSceneString::find(entity);
+    if (! name)
+        return 0;
+    
+    for(DotSceneStringVector::iterator it=mDynamicEntities.begin(); it!=mDynamicEntities.end(); it++)
     {
-        if (entity == *it) 
+        if (*it == name) 
             return mSceneMgr->getEntity(entity);
     }
     
-    for(StringVector::iterator it=mStaticEntities.begin(); it!=mStaticEntities.end(); it++)
+    for(DotSceneStringVector::iterator it=mStaticEntities.begin(); it!=mStaticEntities.end(); it++)
     {
-        if (entity == *it) 
+        if (*it == name) 
             return mSceneMgr->getEntity(entity);
     }
     
     return 0;
 }
 //----------------------------------------------------------------------------
+InstancedEntity* DotScene::getInstancedEntity(const String& entity)
+{
+    DotSceneString name;
+    if (! DotSceneString::find(entity, name))
+        return 0;
+    
+    std::map<DotSceneString, InstancedEntity*>::iterator it = mInstancedEntities.find(name);
+    return (mInstancedEntities.end() != it)? it->second: 0;
+}
+//----------------------------------------------------------------------------
+/** find scene name or name without scene prefix in list (both are tried: either may be interned by other objects) */
+static bool findScopedName(const DotSceneStringVector& names, const String& name, const String& prefix, 
+                           DotSceneString& found)
+{
+    if ((DotSceneString::find(name, found)) && (names.end() != std::find(names.begin(), names.end(), found)))
+        return true;
+    if ((DotSceneString::find(prefix + name, found)) && (names.end() != std::find(names.begin(), names.end(), found)))
+        return true;
+    return false;
+}
+//----------------------------------------------------------------------------
+StaticGeometry* DotScene::getStaticGeometry(const String& geometry)
+{
+    DotSceneString name;
+    if (! findScopedName(mStaticGeometries, geometry, mPrefix, name))
+        return 0;
+    
+    return mSceneMgr->getStaticGeometry(name.str());
+}
+//----------------------------------------------------------------------------
+InstancedGeometry* DotScene::getInstancedGeometry(const String& geometry)
+{
+    DotSceneString name;
+    if (! findScopedName(mInstancedGeometries, geometry, mPrefix, name))
+        return 0;
+    
+    return mSceneMgr->getInstancedGeometry(name.str());
+}
+//----------------------------------------------------------------------------
+AnimationState* DotScene::getAnimationState(const String& animation)
+{
+    //scene name or name without scene prefix
+    for(std::vector<AnimationState*>::iterator it=mAnimationStates.begin(); it!=mAnimationStates.end(); it++)
+    {
+        const String& name = (*it)->getAnimationName();
+        if ((animation == name) || (mPrefix + animation == name))
+            return *it;
+    }
+    return 0;
+}
+//----------------------------------------------------------------------------
 Light* DotScene::getLight(const String& light)
 {
-    for(StringVector::iterator it=mLights.begin(); it!=mLights.end(); it++)
+    //strings never interned can't name an object in scene
+    const DotSceneStringEntry* name = DotSceneString::find(light);
+    if (! name)
+        return 0;
+    
+    for(DotSceneStringVector::iterator it=mLights.begin(); it!=mLights.end(); it++)
     {
-        if (light == *it) 
+        if (*it == name) 
             return mSceneMgr->getLight(light);
     }
     
@@ -3990,9 +5515,14 @@ Light* DotScene::getLight(const String& light)
 //----------------------------------------------------------------------------
 Camera* DotScene::getCamera(const String& camera)
 {
-    for(StringVector::iterator it=mCameras.begin(); it!=mCameras.end(); it++)
+    //strings never interned can't name an object in scene
+    const DotSceneStringEntry* name = DotSceneString::find(camera);
+    if (! name)
+        return 0;
+    
+    for(DotSceneStringVector::iterator it=mCameras.begin(); it!=mCameras.end(); it++)
     {
-        if (camera == *it) 
+        if (*it == name) 
             return mSceneMgr->getCamera(camera);
     }
     
@@ -4001,9 +5531,14 @@ Camera* DotScene::getCamera(const String& camera)
 //----------------------------------------------------------------------------
 BillboardSet* DotScene::getBillboardSet(const String& billboardSet)
 {
-    for(StringVector::iterator it=mBillboardSets.begin(); it!=mBillboardSets.end(); it++)
+    //strings never interned can't name an object in scene
+    const DotSceneStringEntry* name = DotSceneString::find(billboardSet);
+    if (! name)
+        return 0;
+    
+    for(DotSceneStringVector::iterator it=mBillboardSets.begin(); it!=mBillboardSets.end(); it++)
     {
-        if (billboardSet == *it) 
+        if (*it == name) 
             return mSceneMgr->getBillboardSet(billboardSet);
     }
     
@@ -4012,9 +5547,14 @@ BillboardSet* DotScene::getBillboardSet(const String& billboardSet)
 //----------------------------------------------------------------------------
 ParticleSystem* DotScene::getParticleSystem(const String& particleSystem)
 {
-    for(StringVector::iterator it=mParticleSystem.begin(); it!=mParticleSystem.end(); it++)
+    //strings never interned can't name an object in scene
+    const DotSceneStringEntry* name = DotSceneString::find(particleSystem);
+    if (! name)
+        return 0;
+    
+    for(DotSceneStringVector::iterator it=mParticleSystem.begin(); it!=mParticleSystem.end(); it++)
     {
-        if (particleSystem == *it) 
+        if (*it == name) 
             return mSceneMgr->getParticleSystem(particleSystem);
     }
     
@@ -4023,9 +5563,14 @@ ParticleSystem* DotScene::getParticleSystem(const String& particleSystem)
 //----------------------------------------------------------------------------
 Mesh* DotScene::getMesh(const String& mesh)
 {
-    for(StringVector::iterator it=mMeshes.begin(); it!=mMeshes.end(); it++)
+    //strings never interned can't name an object in scene
+    const DotSceneStringEntry* name = DotSceneString::find(mesh);
+    if (! name)
+        return 0;
+    
+    for(DotSceneStringVector::iterator it=mMeshes.begin(); it!=mMeshes.end(); it++)
     {
-        if (mesh == *it) 
+        if (*it == name) 
         {
             MeshPtr ptr = MeshManager::getSingletonPtr()->getByName(mesh);
             assert(! ptr.isNull());
@@ -4039,12 +5584,16 @@ Mesh* DotScene::getMesh(const String& mesh)
 const PropertyList DotScene::getProperties(const String& node)
 {
     PropertyList proplst;
+    DotSceneString reference;
+    if (! DotSceneString::find(node, reference))
+        return proplst;
+    
     for(PropertyListIterator it=mProperties.begin(); it!=mProperties.end(); it++)
     {
         NodeProperty* prop = *it;
         assert(prop);
         
-        if (node == prop->mReference)
+        if (reference == prop->mReference)
             proplst.push_back(prop);
     }
     
@@ -4053,13 +5602,17 @@ const PropertyList DotScene::getProperties(const String& node)
 //----------------------------------------------------------------------------
 const String DotScene::getProperty(const String& node, const String& name)
 {
+    DotSceneString reference, _name;
+    if ((! DotSceneString::find(node, reference)) || (! DotSceneString::find(name, _name)))
+        return StringUtil::BLANK;
+    
     for(PropertyListIterator it=mProperties.begin(); it!=mProperties.end(); it++)
     {
         NodeProperty* prop = *it;
         assert(prop);
         
         log("Propiedad " + prop->mName + " del objeto " + prop->mReference + " con valor " + prop->mValue);
-        if ((node == prop->mReference) && (name == prop->mName))
+        if ((reference == prop->mReference) && (_name == prop->mName))
             return ((StringUtil::BLANK == prop->mValue)? prop->mName :prop->mValue);
     }
     
@@ -4095,128 +5648,2828 @@ bool DotScene::getPropertyBool(const String& node, const String& name)
     return false;
 }
 //----------------------------------------------------------------------------
-Camera* DotScene::getDefaultCamera(int idx_viewport/*=0*/)
-{
-    std::map<int,String>::iterator it = mDefaultCameras.find(idx_viewport);
-    if (mDefaultCameras.end() != it)
-    {
-        String camera = it->second;
-        
-        if (mSceneMgr->hasCamera(camera))
-            return mSceneMgr->getCamera(camera);
-    }
-    
-    return 0;
-}
-//----------------------------------------------------------------------------
-Camera* DotScene::setDefaultCamera(const String& camera, int idx_viewport/*=0*/, int zorder/*=0*/)
+void DotScene::buildAnimationLods()
 {
-    assert(StringUtil::BLANK != camera);
-    assert(mSceneMgr->getCamera(camera));
-    //assert(mCameras.size());
-   
-//     StringVector::iterator it_camera = mCameras.begin();
-//     for(StringVector::iterator it_camera=mCameras.begin(); it_camera!=mCameras.end(); it_camera++)
-//     {
-//         if (camera == *it_camera) break;
-//     }
-//     assert(it_camera != mCameras.end());
-   
-    log("Setting default camera " + camera + " to viewport "  + stringify(idx_viewport));
-    
-    std::map<int,String>::iterator it_default = mDefaultCameras.find(idx_viewport);
-    if (it_default != mDefaultCameras.end())
-        mDefaultCameras.erase(it_default);
-    
-    mDefaultCameras.insert(std::make_pair<int,String>(idx_viewport,camera));
-    
-    Root* root = Root::getSingletonPtr();
-    RenderWindow* window = root->getAutoCreatedWindow();
+    TRACE_FUNC();
+    mSkeletalLods.clear();
     
-    if (window->getNumViewports())
+    //Entity thresholds (userData "animationLodDistance")
+    std::map<DotSceneString, Real> distances;
+    for(PropertyListIterator it=mProperties.begin(); it!=mProperties.end(); it++)
     {
-        Viewport* viewport = window->getViewport(idx_viewport);
-        viewport->setCamera(mSceneMgr->getCamera(camera));
+        if ("animationLodDistance" == (*it)->mName.str())
+            distances[(*it)->mReference] = StringConverter::parseReal((*it)->mValue);
     }
-    else
+    
+    for(DotSceneStringVector::iterator it=mDynamicEntities.begin(); it!=mDynamicEntities.end(); it++)
     {
-        Viewport* viewport = window->addViewport(mSceneMgr->getCamera(camera), zorder);
-        viewport->setBackgroundColour(mBackgroundColor);
+        Entity* entity = mSceneMgr->getEntity(*it);
+        if ((! entity->hasSkeleton()) || (! entity->getAllAnimationStates()))
+            continue;
+        
+        SkeletalLodType lod;
+        lod.mEntity = entity;
+        lod.mDistance = mAnimationLodDistance;
+        lod.mElapsed = 0;
+        lod.mPhase = mSkeletalLods.size();
+        
+        std::map<DotSceneString, Real>::iterator it_distance = distances.find(*it);
+        if (distances.end() != it_distance)
+            lod.mDistance = std::max(it_distance->second, (Real)0);
+        
+        mSkeletalLods.push_back(lod);
     }
+    
+    log("Animation LOD: " + stringify((int)mSkeletalLods.size()) + " skinned entities");
 }
 //----------------------------------------------------------------------------
-void DotScene::viewSceneFromCamera(const String& camera, bool fitToWholeScene/*=false*/)
-{
-    assert(false);
-}
-//----------------------------------------------------------------------------
-void DotScene::update(Real delta)
+void DotScene::scheduleAnimationLods(Real delta)
 {
-    assert(false);
+    //Reference camera: first viewport of rendering window
+    Camera* camera = 0;
+    RenderWindow* window = Root::getSingletonPtr()->getAutoCreatedWindow();
+    if ((window) && (window->getNumViewports()))
+        camera = window->getViewport(0)->getCamera();
+    
+    mFrame++;
+    mSkeletalDue.clear();
+    for(size_t i=0; i<mSkeletalLods.size(); i++)
+    {
+        SkeletalLodType& lod = mSkeletalLods[i];
+        lod.mElapsed += delta;
+        
+        //Hidden or beyond rendering distance: skipped (time applied once visible)
+        Entity* entity = lod.mEntity;
+        if ((! entity->isInScene()) || (! entity->isVisible()))
+            continue;
+        
+        //Interval doubles each time full rate distance doubles, off-screen at max interval
+        int interval = 1;
+        if (camera)
+        {
+            //Bounds from local transforms (derived node data isn't updated while scenes are prepared)
+            Vector3 position, scale;
+            Quaternion orientation;
+            getWorldTransform(entity->getParentNode(), position, orientation, scale);
+            
+            const MeshPtr& mesh = entity->getMesh();
+            Vector3 center = position + orientation * (scale * mesh->getBounds().getCenter());
+            Real radius = mesh->getBoundingSphereRadius() * 
+                          std::max(std::max(Math::Abs(scale.x), Math::Abs(scale.y)), Math::Abs(scale.z));
+            
+            if (! camera->isVisible(Sphere(center, radius)))
+            {
+                interval = mAnimationLodInterval;
+            }
+            else
+            {
+                Real distance2 = camera->getDerivedPosition().squaredDistance(center);
+                Real threshold2 = lod.mDistance * lod.mDistance;
+                while ((distance2 > threshold2) && (interval < mAnimationLodInterval))
+                {
+                    interval = std::min(interval * 2, mAnimationLodInterval);
+                    threshold2 *= 4;
+                }
+            }
+        }
+        
+        //Staggered: entities with same interval are updated on different frames
+        if (0 == ((mFrame + lod.mPhase) % interval))
+            mSkeletalDue.push_back(i);
+    }
 }
 //----------------------------------------------------------------------------
-void DotScene::showBoundingBoxes()
+void DotScene::applyAnimationLods()
 {
-    for(StringVector::iterator it=mSceneNodes.begin(); it!=mSceneNodes.end(); it++)
+    //States not changed aren't dirty: Ogre skips skinning of entities not due
+    for(std::vector<size_t>::iterator it=mSkeletalDue.begin(); it!=mSkeletalDue.end(); it++)
     {
-        SceneNode* node = mSceneMgr->getSceneNode(*it);
-        node->showBoundingBox(true);
+        SkeletalLodType& lod = mSkeletalLods[*it];
+        
+        ConstEnabledAnimationStateIterator it_state = lod.mEntity->getAllAnimationStates()->getEnabledAnimationStateIterator();
+        while (it_state.hasMoreElements())
+            it_state.getNext()->addTime(lod.mElapsed);
+        lod.mElapsed = 0;
     }
+    mSkeletalDue.clear();
 }
 //----------------------------------------------------------------------------
-void DotScene::hideBoundingBoxes()
+void DotScene::buildStaticBatches()
 {
-    for(StringVector::iterator it=mSceneNodes.begin(); it!=mSceneNodes.end(); it++)
+    TRACE_FUNC();
+    
+    //One StaticGeometry by render queue, rendering distance, visibility flags & shadows 
+    //(StaticGeometry already splits each region by material & LOD)
+    std::map<String, StaticGeometry*> batches;
+    
+    //Entities hidden by its node stay entities (batches can't hide a single entity)
+    std::vector<Entity*> candidates;
+    candidates.swap(mBatchedEntities);
+    for(std::vector<Entity*>::iterator it=candidates.begin(); it!=candidates.end(); it++)
     {
-        SceneNode* node = mSceneMgr->getSceneNode(*it);
-        node->showBoundingBox(false);
+        if ((*it)->getVisible())
+            mBatchedEntities.push_back(*it);
+    }
+    
+    for(std::vector<Entity*>::iterator it=mBatchedEntities.begin(); it!=mBatchedEntities.end(); it++)
+    {
+        Entity* entity = *it;
+        Node* node = entity->getParentNode();
+        
+        String key = stringify((int)entity->getRenderQueueGroup()) + "|" + 
+                     stringify(entity->getRenderingDistance()) + "|" + 
+                     stringify((long int)entity->getVisibilityFlags()) + "|" + 
+                     stringify(entity->getCastShadows());
+        
+        StaticGeometry* geometry = 0;
+        std::map<String, StaticGeometry*>::iterator it_batch = batches.find(key);
+        if (batches.end() == it_batch)
+        {
+            String name = mPrefix + getName() + "StaticBatch" + stringify((int)batches.size());
+            geometry = mSceneMgr->createStaticGeometry(name);
+            geometry->setRegionDimensions(Vector3(mStaticRegionSize, mStaticRegionSize, mStaticRegionSize));
+            geometry->setRenderQueueGroup(entity->getRenderQueueGroup());
+            geometry->setRenderingDistance(entity->getRenderingDistance());
+            geometry->setVisibilityFlags(entity->getVisibilityFlags());
+            geometry->setCastShadows(entity->getCastShadows());
+            
+            mStaticGeometries.push_back(name);
+            batches.insert(std::make_pair(key, geometry));
+        }
+        else
+        {
+            geometry = it_batch->second;
+        }
+        
+        //Transform relative to scene root (scene root is attached to scene manager root)
+        geometry->addEntity(entity, node->_getDerivedPosition(), node->_getDerivedOrientation(), node->_getDerivedScale());
+        
+        //Entity remains for lookups, properties & ray queries
+        entity->setVisible(false);
+    }
+    
+    //Ogre 1.8 creates hardware buffers while building: main thread
+    for(std::map<String, StaticGeometry*>::iterator it=batches.begin(); it!=batches.end(); it++)
+    {
+        it->second->build();
+        it->second->setVisible(getVisible());
     }
+    
+    std::sort(mBatchedEntities.begin(), mBatchedEntities.end());
+    log("Static batching: " + stringify((int)mBatchedEntities.size()) + " entities in " + 
+        stringify((int)batches.size()) + " static geometries");
 }
-
 //----------------------------------------------------------------------------
-void DotScene::showSkeletons()
+MeshPtr DotScene::prepareMesh(const String& mesh, bool tangents, bool edgeList, bool lods/*=false*/)
 {
-    for(StringVector::iterator it=mDynamicEntities.begin(); it!=mDynamicEntities.end(); it++)
+    TRACE_FUNC();
+    
+    MeshManager& meshes = MeshManager::getSingleton();
+    DotSceneManager* manager = static_cast<DotSceneManager*>(mCreator);
+    
+    //Mesh already loaded (this or another scene): never loaded twice
+    MeshPtr meshPtr = meshes.getByName(mesh, mGroup);
+    String cacheName = StringUtil::BLANK;
+    if ((meshPtr.isNull()) || (! meshPtr->isLoaded()))
     {
-        Entity* entity = mSceneMgr->getEntity(*it);
-        if (entity->hasSkeleton()) entity->setDisplaySkeleton(true);
+        cacheName = manager->_getMeshCacheName(mesh, mGroup);
+        
+        //Cached mesh with derived data (same name & content)
+        if (StringUtil::BLANK != cacheName)
+        {
+            std::ifstream cached((manager->getMeshCacheDirectory() + "/" + cacheName).c_str());
+            if (cached.good())
+                meshPtr = meshes.load(cacheName, MESH_CACHE_GROUP, 
+                                      HardwareBuffer::HBU_STATIC_WRITE_ONLY, HardwareBuffer::HBU_STATIC_WRITE_ONLY,
+                                      mRaycastAtLoad, mRaycastAtLoad);
+        }
+    }
+    //Ray queries read triangles from shadow buffers (hardware buffers are write only)
+    if ((meshPtr.isNull()) || (! meshPtr->isLoaded()))
+        meshPtr = meshes.load(mesh, mGroup, 
+                              HardwareBuffer::HBU_STATIC_WRITE_ONLY, HardwareBuffer::HBU_STATIC_WRITE_ONLY,
+                              mRaycastAtLoad, mRaycastAtLoad);
+    
+    //Derived data not in mesh file: build once
+    bool modified = false;
+    unsigned short src, dest;
+    if ((tangents) && (! meshPtr->suggestTangentVectorBuildParams(VES_TANGENT, src, dest)))
+    {
+        meshPtr->buildTangentVectors(VES_TANGENT, src, dest);
+        modified = true;
+    }
+    if ((edgeList) && (! meshPtr->isEdgeListBuilt()))
+    {
+        meshPtr->buildEdgeList();
+        modified = true;
+    }
+    
+    //Progressive mesh reduction (authored LOD levels are kept): distances from bounding radius
+    if ((lods) && (1 == meshPtr->getNumLodLevels()) && (mLodPolicy.mLevels) && (mLodPolicy.mLodDistance > 0))
+    {
+        Real radius = meshPtr->getBoundingSphereRadius();
+        
+        Mesh::LodValueList values;
+        for(unsigned short i=1; i<=mLodPolicy.mLevels; i++)
+            values.push_back(radius * mLodPolicy.mLodDistance * i);
+        
+        meshPtr->generateLodLevels(values, ProgressiveMesh::VRQ_PROPORTIONAL, mLodPolicy.mReduction);
+        log("Generated " + stringify((int)mLodPolicy.mLevels) + " LOD levels for mesh " + mesh);
+        modified = true;
+    }
+    
+    //Next loads read derived data from cache
+    if ((modified) && (StringUtil::BLANK != cacheName))
+    {
+        try
+        {
+            MeshSerializer serializer;
+            serializer.exportMesh(meshPtr.getPointer(), manager->getMeshCacheDirectory() + "/" + cacheName);
+            log("Mesh cache: " + mesh + " saved as " + cacheName);
+        }
+        catch(Exception &e)
+        {
+            log("Error: Mesh cache not saved -> " + e.getFullDescription());
+        }
     }
+    
+    return meshPtr;
 }
 //----------------------------------------------------------------------------
-void DotScene::hideSkeletons()
+MaterialPtr DotScene::getMaterialVariant(const String& material, bool receiveShadows)
 {
-    for(StringVector::iterator it=mDynamicEntities.begin(); it!=mDynamicEntities.end(); it++)
+    MaterialManager* materials = MaterialManager::getSingletonPtr();
+    
+    //Shared materials are never modified: base material fits or a variant is used
+    MaterialPtr base = materials->getByName(material);
+    if ((base.isNull()) || (base->getReceiveShadows() == receiveShadows))
+        return base;
+    
+    //Variant cloned once (name keyed by base material & overridden flags), shared by all scenes
+    String name = material + ((receiveShadows)? "/DotScene/ReceiveShadows": "/DotScene/NoReceiveShadows");
+    MaterialPtr variant = materials->getByName(name);
+    if (variant.isNull())
     {
-        Entity* entity = mSceneMgr->getEntity(*it);
-        if (entity->hasSkeleton()) entity->setDisplaySkeleton(true);
+        variant = base->clone(name);
+        variant->setReceiveShadows(receiveShadows);
+        log("Material variant " + name);
     }
+    
+    return variant;
 }
 //----------------------------------------------------------------------------
-bool DotScene::exportToFile(const String& filename/*=StringUtil::BLANK*/)
+void DotScene::setLodRenderingDistance(Entity* entity, const Vector3& scale)
 {
-    TRACE_FUNC();
+    //LOD distances are shared by mesh: scaled entities switch levels at scaled distances
+    Real maxScale = std::max(std::max(Math::Abs(scale.x), Math::Abs(scale.y)), Math::Abs(scale.z));
+    if ((entity->getMesh()->getNumLodLevels() > 1) && (maxScale > 0) && (1 != maxScale))
+        entity->setMeshLodBias(maxScale);
     
-    if (! helper) 
-        helper = new DotScenePersistenceHelper(this);
+    //Authored rendering distance is kept
+    if ((mLodPolicy.mRenderingDistance <= 0) || (entity->getRenderingDistance() > 0))
+        return;
     
-    helper->persist();
+    Real radius = entity->getMesh()->getBoundingSphereRadius() * maxScale;
+    Real distance = radius * mLodPolicy.mRenderingDistance;
+    if (distance <= 0)
+        return;
     
-    return true;
+    //Rounded up to power of two: static batches group entities by rendering distance
+    entity->setRenderingDistance(Math::Pow(2, Math::Ceil(Math::Log2(distance))));
 }
-
-/*****************************************************************************/
-/** DotScenePtr                                                              */                   
-/*****************************************************************************/
-DotScenePtr::DotScenePtr() : SharedPtr<DotScene>() 
-{}
-//----------------------------------------------------------------------------
-DotScenePtr::DotScenePtr(DotScene* scene) : SharedPtr<DotScene>(scene) 
-{}
 //----------------------------------------------------------------------------
-DotScenePtr::DotScenePtr(const DotScenePtr& scenePtr) : SharedPtr<DotScene>(scenePtr) 
-{}
+/** Functor: order name index entries by key */
+struct DotSceneKeyLess
+{
+    template<typename T>
+    bool operator()(const T& a, const T& b) const { return a.mKey < b.mKey; }
+    template<typename T>
+    bool operator()(const T& a, const String& b) const { return a.mKey < b; }
+};
 //----------------------------------------------------------------------------
-DotScenePtr::DotScenePtr(const ResourcePtr& r) 
+String DotScene::getLocalName(const String& name)
+{
+    if ((mPrefix.size()) && (0 == name.compare(0, mPrefix.size(), mPrefix)))
+        return name.substr(mPrefix.size());
+    
+    return name;
+}
+//----------------------------------------------------------------------------
+void DotScene::buildNameIndex()
+{
+    TRACE_FUNC();
+    
+    mNameIndex.clear();
+    mPathIndex.clear();
+    
+    //Index by name
+    const DotSceneStringVector* lists[] = { &mSceneNodes, &mDynamicEntities, &mStaticEntities, &mLights, 
+                                            &mCameras, &mBillboardSets, &mParticleSystem, &mMeshes };
+    const NodePropertyType types[] = { SCENE_NODE, ENTITY, ENTITY, LIGHT, 
+                                       CAMERA, BILLBOARD_SET, PARTICLE_SYSTEM, MESH };
+    
+    size_t count = 0;
+    for(int l=0; l<8; l++)
+        count += lists[l]->size();
+    mNameIndex.reserve(count);
+    
+    for(int l=0; l<8; l++)
+    {
+        for(DotSceneStringVector::const_iterator it=lists[l]->begin(); it!=lists[l]->end(); it++)
+        {
+            NameIndexEntryType entry;
+            entry.mKey = getLocalName(*it);
+            entry.mName = *it;
+            entry.mType = types[l];
+            mNameIndex.push_back(entry);
+        }
+    }
+    
+    //Instanced entities (Ogre names are generated by its batch)
+    std::map<DotSceneString, InstancedEntity*>::iterator it_instanced;
+    for(it_instanced=mInstancedEntities.begin(); it_instanced!=mInstancedEntities.end(); it_instanced++)
+    {
+        NameIndexEntryType entry;
+        entry.mKey = getLocalName(it_instanced->first);
+        entry.mName = it_instanced->first;
+        entry.mType = ENTITY;
+        mNameIndex.push_back(entry);
+    }
+    std::sort(mNameIndex.begin(), mNameIndex.end(), DotSceneKeyLess());
+    
+    //Index by hierarchy path
+    mPathIndex.reserve(count);
+    Node::ChildNodeIterator it = mSceneRoot->getChildIterator();
+    while (it.hasMoreElements())
+    {
+        SceneNode* child = static_cast<SceneNode*>(it.getNext());
+        
+        //Wrapper node created by processNodes is always "Nodes" (its name is scene dependent)
+        String segment = (mNodesRoot == child)? String("Nodes"): getLocalName(child->getName());
+        
+        buildPathIndex(child, segment);
+    }
+    std::sort(mPathIndex.begin(), mPathIndex.end(), DotSceneKeyLess());
+}
+//----------------------------------------------------------------------------
+void DotScene::buildPathIndex(SceneNode* node, const String& path)
+{
+    NameIndexEntryType entry;
+    entry.mKey = path;
+    entry.mName = node->getName();
+    entry.mType = SCENE_NODE;
+    mPathIndex.push_back(entry);
+    
+    //Attached objects
+    SceneNode::ObjectIterator objects = node->getAttachedObjectIterator();
+    while (objects.hasMoreElements())
+    {
+        MovableObject* object = objects.getNext();
+        const String& movableType = object->getMovableType();
+        
+        if ("Entity" == movableType) entry.mType = ENTITY;
+        else if ("InstancedEntity" == movableType) entry.mType = ENTITY;
+        else if ("Light" == movableType) entry.mType = LIGHT;
+        else if ("Camera" == movableType) entry.mType = CAMERA;
+        else if ("ParticleSystem" == movableType) entry.mType = PARTICLE_SYSTEM;
+        else if ("BillboardSet" == movableType) entry.mType = BILLBOARD_SET;
+        else continue;
+        
+        entry.mName = object->getName();
+        if ("InstancedEntity" == movableType)
+            entry.mName = mInstancedNames[object];
+        entry.mKey = path + "/" + getLocalName(entry.mName);
+        mPathIndex.push_back(entry);
+    }
+    
+    //Children nodes
+    Node::ChildNodeIterator it = node->getChildIterator();
+    while (it.hasMoreElements())
+    {
+        SceneNode* child = static_cast<SceneNode*>(it.getNext());
+        buildPathIndex(child, path + "/" + getLocalName(child->getName()));
+    }
+}
+//----------------------------------------------------------------------------
+StringVector DotScene::findObjectsByPrefix(const String& prefix, NodePropertyType type/*=UNKNOWN*/)
+{
+    StringVector objects;
+    
+    NameIndexType::iterator it = std::lower_bound(mNameIndex.begin(), mNameIndex.end(), prefix, DotSceneKeyLess());
+    for(; it!=mNameIndex.end(); it++)
+    {
+        if (0 != it->mKey.compare(0, prefix.size(), prefix))
+            break;
+        
+        if ((UNKNOWN == type) || (type == it->mType))
+            objects.push_back(it->mName);
+    }
+    
+    return objects;
+}
+//----------------------------------------------------------------------------
+StringVector DotScene::findObjectsUnderPath(const String& path, NodePropertyType type/*=UNKNOWN*/)
+{
+    StringVector objects;
+    
+    String prefix = path;
+    if ((prefix.empty()) || ('/' != prefix[prefix.size() - 1]))
+        prefix.append("/");
+    
+    NameIndexType::iterator it = std::lower_bound(mPathIndex.begin(), mPathIndex.end(), prefix, DotSceneKeyLess());
+    for(; it!=mPathIndex.end(); it++)
+    {
+        if (0 != it->mKey.compare(0, prefix.size(), prefix))
+            break;
+        
+        if ((UNKNOWN == type) || (type == it->mType))
+            objects.push_back(it->mName);
+    }
+    
+    return objects;
+}
+//----------------------------------------------------------------------------
+const String& DotScene::resolvePath(const String& path, NodePropertyType* type/*=0*/)
+{
+    NameIndexType::iterator it = std::lower_bound(mPathIndex.begin(), mPathIndex.end(), path, DotSceneKeyLess());
+    if ((mPathIndex.end() == it) || (path != it->mKey))
+        return StringUtil::BLANK;
+    
+    if (type)
+        *type = it->mType;
+    
+    return it->mName;
+}
+//----------------------------------------------------------------------------
+SceneNode* DotScene::getSceneNodeByPath(const String& path)
+{
+    NameIndexType::iterator it = std::lower_bound(mPathIndex.begin(), mPathIndex.end(), path, DotSceneKeyLess());
+    for(; (it!=mPathIndex.end()) && (path == it->mKey); it++)
+    {
+        if (SCENE_NODE == it->mType)
+            return mSceneMgr->getSceneNode(it->mName);
+    }
+    
+    return 0;
+}
+//----------------------------------------------------------------------------
+Camera* DotScene::getDefaultCamera(int idx_viewport/*=0*/)
+{
+    std::map<int,String>::iterator it = mDefaultCameras.find(idx_viewport);
+    if (mDefaultCameras.end() != it)
+    {
+        String camera = it->second;
+        
+        if (mSceneMgr->hasCamera(camera))
+            return mSceneMgr->getCamera(camera);
+    }
+    
+    return 0;
+}
+//----------------------------------------------------------------------------
+Camera* DotScene::setDefaultCamera(const String& camera, int idx_viewport/*=0*/, int zorder/*=0*/)
+{
+    assert(StringUtil::BLANK != camera);
+    assert(mSceneMgr->getCamera(camera));
+    //assert(mCameras.size());
+   
+//     StringVector::iterator it_camera = mCameras.begin();
+//     for(StringVector::iterator it_camera=mCameras.begin(); it_camera!=mCameras.end(); it_camera++)
+//     {
+//         if (camera == *it_camera) break;
+//     }
+//     assert(it_camera != mCameras.end());
+   
+    log("Setting default camera " + camera + " to viewport "  + stringify(idx_viewport));
+    
+    std::map<int,String>::iterator it_default = mDefaultCameras.find(idx_viewport);
+    if (it_default != mDefaultCameras.end())
+        mDefaultCameras.erase(it_default);
+    
+    mDefaultCameras.insert(std::make_pair<int,String>(idx_viewport,camera));
+    
+    Root* root = Root::getSingletonPtr();
+    RenderWindow* window = root->getAutoCreatedWindow();
+    
+    if (window->getNumViewports())
+    {
+        Viewport* viewport = window->getViewport(idx_viewport);
+        viewport->setCamera(mSceneMgr->getCamera(camera));
+    }
+    else
+    {
+        Viewport* viewport = window->addViewport(mSceneMgr->getCamera(camera), zorder);
+        viewport->setBackgroundColour(mBackgroundColor);
+        viewport->setVisibilityMask(viewport->getVisibilityMask() & 
+                                    ~static_cast<DotSceneManager*>(mCreator)->_getHiddenLayers());
+    }
+    
+    return mSceneMgr->getCamera(camera);
+}
+//----------------------------------------------------------------------------
+void DotScene::viewSceneFromCamera(const String& camera, bool fitToWholeScene/*=false*/)
+{
+    TRACE_FUNC();
+    
+    //scene camera (with or without scene prefix) or any camera of scene manager
+    Camera* cameraPtr = getCamera(camera);
+    if (! cameraPtr)
+        cameraPtr = getCamera(mPrefix + camera);
+    if ((! cameraPtr) && (mSceneMgr->hasCamera(camera)))
+        cameraPtr = mSceneMgr->getCamera(camera);
+    if (! cameraPtr)
+    {
+        log("Error: Unknown camera " + camera);
+        return;
+    }
+    
+    setDefaultCamera(cameraPtr->getName());
+    if (fitToWholeScene)
+        fitCamera(cameraPtr->getName());
+}
+//----------------------------------------------------------------------------
+const AxisAlignedBox& DotScene::getWorldBounds(const String& node/*=StringUtil::BLANK*/)
+{
+    static const AxisAlignedBox nullBounds;
+    if (! isLoaded())
+        return nullBounds;
+    
+    SceneNode* sceneNode = mSceneRoot;
+    if (StringUtil::BLANK != node)
+    {
+        sceneNode = getSceneNode(node);
+        if (! sceneNode)
+            sceneNode = getSceneNode(mPrefix + node);
+        if (! sceneNode)
+        {
+            log("Error: Unknown scene node " + node);
+            return nullBounds;
+        }
+    }
+    
+    //pending transforms are applied first (only changed nodes are visited, moved nodes notify cache)
+    mSceneRoot->_update(true, false);
+    return mBounds->getBounds(sceneNode);
+}
+//----------------------------------------------------------------------------
+void DotScene::refreshWorldBounds(const String& node/*=StringUtil::BLANK*/)
+{
+    if (! isLoaded())
+        return;
+    
+    SceneNode* sceneNode = mSceneRoot;
+    if (StringUtil::BLANK != node)
+    {
+        sceneNode = getSceneNode(node);
+        if (! sceneNode)
+            sceneNode = getSceneNode(mPrefix + node);
+        if (! sceneNode)
+        {
+            log("Error: Unknown scene node " + node);
+            return;
+        }
+    }
+    
+    //Subtree walk: new nodes invalidate their ancestors, nodes with application listener aren't cached
+    mBounds->track(sceneNode);
+}
+//----------------------------------------------------------------------------
+void DotScene::fitCamera(const String& camera, const String& node/*=StringUtil::BLANK*/)
+{
+    TRACE_FUNC();
+    
+    Camera* cameraPtr = getCamera(camera);
+    if (! cameraPtr)
+        cameraPtr = getCamera(mPrefix + camera);
+    if ((! cameraPtr) && (mSceneMgr->hasCamera(camera)))
+        cameraPtr = mSceneMgr->getCamera(camera);
+    if (! cameraPtr)
+    {
+        log("Error: Unknown camera " + camera);
+        return;
+    }
+    
+    const AxisAlignedBox& bounds = getWorldBounds(node);
+    if (! bounds.isFinite())
+        return;
+    
+    //Bounding sphere seen along current camera direction
+    Vector3 center = bounds.getCenter();
+    Real radius = std::max(bounds.getHalfSize().length(), (Real)1e-3);
+    Real aspect = cameraPtr->getAspectRatio();
+    
+    Real distance = 0;
+    if (PT_ORTHOGRAPHIC == cameraPtr->getProjectionType())
+    {
+        if (aspect >= 1)
+            cameraPtr->setOrthoWindowHeight(2 * radius);
+        else
+            cameraPtr->setOrthoWindowWidth(2 * radius);
+        distance = radius + cameraPtr->getNearClipDistance();
+    }
+    else
+    {
+        Radian fovY = cameraPtr->getFOVy();
+        Radian fovX = 2 * Math::ATan(Math::Tan(fovY * 0.5f) * aspect);
+        Radian halfFov = std::min(fovY, fovX) * 0.5f;
+        distance = radius / Math::Sin(halfFov);
+    }
+    
+    //far clip distance covers whole bounds (0: infinite)
+    Real farClip = cameraPtr->getFarClipDistance();
+    if ((farClip > 0) && (farClip < distance + radius))
+        cameraPtr->setFarClipDistance(distance + radius);
+    
+    //move camera (or its node) keeping camera orientation
+    Vector3 position = center - cameraPtr->getDerivedDirection() * distance;
+    SceneNode* parent = cameraPtr->getParentSceneNode();
+    if (parent)
+        parent->_setDerivedPosition(parent->_getDerivedPosition() + position - cameraPtr->getDerivedPosition());
+    else
+        cameraPtr->setPosition(position);
+}
+//----------------------------------------------------------------------------
+void DotScene::update(Real delta)
+{
+    if ((! isLoaded()) || (mSleeping))
+        return;
+    
+    _prepareUpdate(delta);
+    _applyUpdate(delta);
+}
+//----------------------------------------------------------------------------
+void DotScene::_prepareUpdate(Real delta)
+{
+    //Only reads Ogre objects: scenes are prepared in parallel by DotSceneManager::updateAll
+    Timer timer;
+    mUpdateTime = 0;
+    if ((! isLoaded()) || (mSleeping))
+        return;
+    
+    //Skeletal animations due this frame (distance based rates)
+    if (mAnimationLod)
+        scheduleAnimationLods(delta);
+    
+    //Look & track targets (batched)
+    mConstraints->prepare();
+    
+    mUpdateTime = timer.getMicroseconds();
+}
+//----------------------------------------------------------------------------
+void DotScene::_applyUpdate(Real delta)
+{
+    Timer timer;
+    if (! isLoaded())
+        return;
+    if (mSleeping)
+        return;
+    
+    //Node animations: advance all enabled states in one pass
+    for(std::vector<AnimationState*>::iterator it=mAnimationStates.begin(); it!=mAnimationStates.end(); it++)
+    {
+        if ((*it)->getEnabled())
+            (*it)->addTime(delta);
+    }
+    
+    //Skeletal animations due this frame
+    if (mAnimationLod)
+        applyAnimationLods();
+    
+    //Look & track targets: written back only if changed
+    mConstraints->apply();
+    
+    //Note tracks (after animation states are advanced)
+    if (mNoteTracks.size())
+        updateNoteTracks(delta);
+    
+    mUpdateTime += timer.getMicroseconds();
+}
+//----------------------------------------------------------------------------
+unsigned long DotScene::getLastUpdateTime() const
+{
+    return mUpdateTime;
+}
+//----------------------------------------------------------------------------
+void DotScene::setSleeping(bool sleeping, Real fastForward/*=0*/)
+{
+    //Unloaded while sleeping (explicit unload or eviction): waking shows it as it was
+    if ((! sleeping) && (! isLoaded()))
+    {
+        if ((mEvicted) && (mSleepVisible))
+            setVisible(true);
+        mSleepVisible = false;
+        return;
+    }
+    if ((sleeping == mSleeping) || (! isLoaded()))
+        return;
+    
+    if (sleeping)
+    {
+        log("Sleeping scene " + mName);
+        mSleepVisible = getVisible();
+        mSleepStart = Root::getSingletonPtr()->getTimer()->getMilliseconds();
+        suspend();
+        mSleeping = true;
+        
+        //Last statement: manager may evict this scene (resumed by cleanResources)
+        if (mSleepVisible)
+            setVisible(false);
+    }
+    else
+    {
+        //Time slept from Root clock (sleeping scenes aren't updated)
+        Real slept = (Root::getSingletonPtr()->getTimer()->getMilliseconds() - mSleepStart) / (Real)1000;
+        log("Waking scene " + mName + " (" + stringify(slept) + " s)");
+        mSleeping = false;
+        resume(std::min(slept, fastForward));
+        
+        if (mSleepVisible)
+            setVisible(true);
+    }
+}
+//----------------------------------------------------------------------------
+bool DotScene::getSleeping() const
+{
+    return mSleeping;
+}
+//----------------------------------------------------------------------------
+void DotScene::suspend()
+{
+    //Enabled animation states: scene manager applies node animations every frame
+    for(std::vector<AnimationState*>::iterator it=mAnimationStates.begin(); it!=mAnimationStates.end(); it++)
+    {
+        if ((*it)->getEnabled())
+            mSleepAnimations.push_back(*it);
+    }
+    for(DotSceneStringVector::iterator it=mDynamicEntities.begin(); it!=mDynamicEntities.end(); it++)
+    {
+        if (! mSceneMgr->hasEntity(*it))
+            continue;
+        
+        AnimationStateSet* states = mSceneMgr->getEntity(*it)->getAllAnimationStates();
+        if (! states)
+            continue;
+        
+        ConstEnabledAnimationStateIterator it_state = states->getEnabledAnimationStateIterator();
+        while (it_state.hasMoreElements())
+            mSleepAnimations.push_back(it_state.getNext());
+    }
+    for(std::vector<AnimationState*>::iterator it=mSleepAnimations.begin(); it!=mSleepAnimations.end(); it++)
+        (*it)->setEnabled(false);
+    
+    //Particle systems: frozen (skipped by Ogre once not visible for timeout)
+    for(DotSceneStringVector::iterator it=mParticleSystem.begin(); it!=mParticleSystem.end(); it++)
+    {
+        if (! mSceneMgr->hasParticleSystem(*it))
+            continue;
+        
+        SleepParticleType particle;
+        particle.mSystem = mSceneMgr->getParticleSystem(*it);
+        particle.mSpeedFactor = particle.mSystem->getSpeedFactor();
+        particle.mTimeout = particle.mSystem->getNonVisibleUpdateTimeout();
+        mSleepParticles.push_back(particle);
+        
+        particle.mSystem->setSpeedFactor(0);
+        particle.mSystem->setNonVisibleUpdateTimeout(std::numeric_limits<Real>::epsilon());
+    }
+    
+    //Render textures: not rendered while sleeping
+    for(DotSceneStringVector::iterator it=mRenderTextures.begin(); it!=mRenderTextures.end(); it++)
+    {
+        TexturePtr texture = TextureManager::getSingletonPtr()->getByName(*it, mGroup);
+        if (texture.isNull())
+            continue;
+        
+        for(size_t i=0; i<texture->getNumFaces(); i++)
+        {
+            RenderTarget* target = texture->getBuffer(i)->getRenderTarget();
+            if (! target->isAutoUpdated())
+                continue;
+            
+            mSleepTargets.push_back(target);
+            target->setAutoUpdated(false);
+        }
+    }
+    
+    log("Suspended " + stringify((int)mSleepAnimations.size()) + " animations, " + 
+        stringify((int)mSleepParticles.size()) + " particle systems, " +
+        stringify((int)mSleepTargets.size()) + " render targets");
+}
+//----------------------------------------------------------------------------
+void DotScene::resume(Real fastForward)
+{
+    for(std::vector<AnimationState*>::iterator it=mSleepAnimations.begin(); it!=mSleepAnimations.end(); it++)
+        (*it)->setEnabled(true);
+    mSleepAnimations.clear();
+    
+    for(std::vector<SleepParticleType>::iterator it=mSleepParticles.begin(); it!=mSleepParticles.end(); it++)
+    {
+        it->mSystem->setSpeedFactor(it->mSpeedFactor);
+        
+        //Catch up time slept (without timeout: system is still not visible)
+        if (fastForward > 0)
+        {
+            it->mSystem->setNonVisibleUpdateTimeout(0);
+            it->mSystem->fastForward(fastForward, SLEEP_FAST_FORWARD_INTERVAL);
+        }
+        it->mSystem->setNonVisibleUpdateTimeout(it->mTimeout);
+    }
+    mSleepParticles.clear();
+    
+    for(std::vector<RenderTarget*>::iterator it=mSleepTargets.begin(); it!=mSleepTargets.end(); it++)
+        (*it)->setAutoUpdated(true);
+    mSleepTargets.clear();
+}
+//----------------------------------------------------------------------------
+void DotScene::setLayerVisible(const String& layer, bool visible)
+{
+    uint32 flags = getLayerFlags(layer);
+    if (! flags)
+    {
+        log("Error: Unknown layer " + layer);
+        return;
+    }
+    
+    //Only bits this scene changes are counted by manager
+    uint32 changed = (visible)? (flags & mHiddenLayers): (flags & ~mHiddenLayers);
+    mHiddenLayers = (visible)? (mHiddenLayers & ~flags): (mHiddenLayers | flags);
+    static_cast<DotSceneManager*>(mCreator)->_setLayersHidden(changed, ! visible);
+}
+//----------------------------------------------------------------------------
+bool DotScene::getLayerVisible(const String& layer) const
+{
+    uint32 flags = getLayerFlags(layer);
+    return (flags) && (flags & ~mHiddenLayers);
+}
+//----------------------------------------------------------------------------
+uint32 DotScene::getLayerFlags(const String& layer) const
+{
+    std::map<String, uint32>::const_iterator it = mLayers.find(layer);
+    return (mLayers.end() != it)? it->second: 0;
+}
+//----------------------------------------------------------------------------
+StringVector DotScene::getLayers() const
+{
+    StringVector layers;
+    for(std::map<String, uint32>::const_iterator it=mLayers.begin(); it!=mLayers.end(); it++)
+        layers.push_back(it->first);
+    return layers;
+}
+//----------------------------------------------------------------------------
+uint32 DotScene::parseLayerFlags(const String& layers)
+{
+    uint32 flags = 0;
+    
+    StringVector names = StringUtil::split(layers, "|, ");
+    for(StringVector::iterator it=names.begin(); it!=names.end(); it++)
+    {
+        //numeric flags or layer name (undeclared layers get a bit shared by all scenes)
+        if (StringConverter::isNumber(*it))
+        {
+            flags |= (uint32)StringConverter::parseUnsignedLong(*it);
+            continue;
+        }
+        
+        if (! mLayers.count(*it))
+        {
+            uint32 bit = static_cast<DotSceneManager*>(mCreator)->_registerLayer(*it, 0);
+            if (! bit)
+                continue;
+            mLayers[*it] = bit;
+        }
+        flags |= mLayers[*it];
+    }
+    
+    return flags;
+}
+//----------------------------------------------------------------------------
+void DotScene::applyLayers()
+{
+    //Nodes first (ancestors before descendants), then objects override them
+    std::vector<std::pair<int, NodeProperty*> > nodes;
+    std::vector<NodeProperty*> objects;
+    for(PropertyListIterator it=mProperties.begin(); it!=mProperties.end(); it++)
+    {
+        if ("layer" != (*it)->mName.str())
+            continue;
+        
+        if (SCENE_NODE == (*it)->mType)
+        {
+            int depth = 0;
+            for(Node* node=static_cast<SceneNodeProperty<SceneNode>*>(*it)->mNode; node; node=node->getParent())
+                depth++;
+            nodes.push_back(std::make_pair(depth, *it));
+        }
+        else
+        {
+            objects.push_back(*it);
+        }
+    }
+    std::sort(nodes.begin(), nodes.end());
+    
+    for(size_t i=0; i<nodes.size(); i++)
+    {
+        uint32 flags = parseLayerFlags(nodes[i].second->mValue);
+        setLayerFlags(static_cast<SceneNodeProperty<SceneNode>*>(nodes[i].second)->mNode, flags);
+    }
+    
+    for(std::vector<NodeProperty*>::iterator it=objects.begin(); it!=objects.end(); it++)
+    {
+        NodeProperty* prop = *it;
+        uint32 flags = parseLayerFlags(prop->mValue);
+        
+        switch (prop->mType)
+        {
+            case ENTITY:
+                if (mInstancedEntities.count(prop->mReference))
+                    static_cast<SceneNodeProperty<InstancedEntity>*>(prop)->mNode->setVisibilityFlags(flags);
+                else
+                    static_cast<SceneNodeProperty<Entity>*>(prop)->mNode->setVisibilityFlags(flags);
+                break;
+            case LIGHT:
+                static_cast<SceneNodeProperty<Light>*>(prop)->mNode->setVisibilityFlags(flags);
+                break;
+            case BILLBOARD_SET:
+                static_cast<SceneNodeProperty<BillboardSet>*>(prop)->mNode->setVisibilityFlags(flags);
+                break;
+            case PARTICLE_SYSTEM:
+                static_cast<SceneNodeProperty<ParticleSystem>*>(prop)->mNode->setVisibilityFlags(flags);
+                break;
+            default:
+                log("Error: Layers not supported by object " + prop->mReference.str());
+                break;
+        }
+    }
+    
+    if (mLayers.size())
+        log("Layers: " + stringify((int)mLayers.size()));
+}
+//----------------------------------------------------------------------------
+void DotScene::setLayerFlags(SceneNode* node, uint32 flags)
+{
+    SceneNode::ObjectIterator it_object = node->getAttachedObjectIterator();
+    while (it_object.hasMoreElements())
+        it_object.getNext()->setVisibilityFlags(flags);
+    
+    SceneNode::ChildNodeIterator it_child = node->getChildIterator();
+    while (it_child.hasMoreElements())
+        setLayerFlags(static_cast<SceneNode*>(it_child.getNext()), flags);
+}
+//----------------------------------------------------------------------------
+void DotScene::addNoteListener(NoteListener* listener)
+{
+    assert(listener);
+    if (mNoteListeners.end() == std::find(mNoteListeners.begin(), mNoteListeners.end(), listener))
+        mNoteListeners.push_back(listener);
+}
+//----------------------------------------------------------------------------
+void DotScene::removeNoteListener(NoteListener* listener)
+{
+    std::vector<NoteListener*>::iterator it = std::find(mNoteListeners.begin(), mNoteListeners.end(), listener);
+    if (mNoteListeners.end() != it)
+        mNoteListeners.erase(it);
+}
+//----------------------------------------------------------------------------
+void DotScene::bindNoteTracks()
+{
+    for(std::vector<NoteTrackType>::iterator it=mNoteTracks.begin(); it!=mNoteTracks.end(); it++)
+    {
+        //Entity animation first, then node animations of scene
+        AnimationStateSet* states = (it->mEntity)? it->mEntity->getAllAnimationStates(): 0;
+        if ((states) && (states->hasAnimationState(it->mName)))
+            it->mState = states->getAnimationState(it->mName);
+        else
+            it->mState = getAnimationState(it->mName);
+        
+        it->mLast = -1;
+        it->mCursor = 0;
+    }
+}
+//----------------------------------------------------------------------------
+void DotScene::updateNoteTracks(Real delta)
+{
+    mNoteTime += delta;
+    
+    for(std::vector<NoteTrackType>::iterator it=mNoteTracks.begin(); it!=mNoteTracks.end(); it++)
+    {
+        NoteTrackType& track = *it;
+        
+        Real now = mNoteTime;
+        if (track.mState)
+        {
+            if (! track.mState->getEnabled())
+                continue;
+            now = track.mState->getTimePosition();
+        }
+        
+        //Clock went back: looped (notes until end first) or rewound (cursor searched)
+        if (now < track.mLast)
+        {
+            if ((track.mState) && (track.mState->getLoop()))
+            {
+                dispatchNotes(track, track.mNotes.size());
+                track.mCursor = 0;
+            }
+            else
+            {
+                NoteType key;
+                key.mTime = now;
+                track.mCursor = std::lower_bound(track.mNotes.begin(), track.mNotes.end(), key, &DotScene::noteLess) - 
+                                track.mNotes.begin();
+                track.mLast = now;
+                continue;
+            }
+        }
+        
+        //Notes reached: (last, now]
+        size_t end = track.mCursor;
+        while ((end < track.mNotes.size()) && (track.mNotes[end].mTime <= now))
+            end++;
+        dispatchNotes(track, end);
+        track.mLast = now;
+    }
+}
+//----------------------------------------------------------------------------
+void DotScene::dispatchNotes(NoteTrackType& track, size_t end)
+{
+    if (mNoteListeners.empty())
+    {
+        track.mCursor = std::max(track.mCursor, end);
+        return;
+    }
+    
+    StringVector notes;
+    while (track.mCursor < end)
+    {
+        //Notes at same time: one dispatch
+        Real time = track.mNotes[track.mCursor].mTime;
+        notes.clear();
+        while ((track.mCursor < end) && (track.mNotes[track.mCursor].mTime == time))
+            notes.push_back(track.mNotes[track.mCursor++].mText);
+        
+        for(std::vector<NoteListener*>::iterator it=mNoteListeners.begin(); it!=mNoteListeners.end(); it++)
+            (*it)->notesReached(this, track.mObject, track.mName, time, notes);
+    }
+}
+//----------------------------------------------------------------------------
+DotSceneMeshBVH* DotScene::getMeshBVH(const MeshPtr& mesh)
+{
+    std::map<String, DotSceneMeshBVH*>::iterator it = mMeshBVHs.find(mesh->getName());
+    if (mMeshBVHs.end() != it)
+        return it->second;
+    
+    DotSceneMeshBVH* bvh = new DotSceneMeshBVH(mesh);
+    mMeshBVHs.insert(std::make_pair(mesh->getName(), bvh));
+    
+    return bvh;
+}
+//----------------------------------------------------------------------------
+void DotScene::buildRaycastData()
+{
+    TRACE_FUNC();
+    
+    for(DotSceneStringVector::iterator it=mDynamicEntities.begin(); it!=mDynamicEntities.end(); it++)
+        getMeshBVH(mSceneMgr->getEntity(*it)->getMesh());
+    for(DotSceneStringVector::iterator it=mStaticEntities.begin(); it!=mStaticEntities.end(); it++)
+        getMeshBVH(mSceneMgr->getEntity(*it)->getMesh());
+}
+//----------------------------------------------------------------------------
+void DotScene::destroyRaycastData()
+{
+    std::map<String, DotSceneMeshBVH*>::iterator it;
+    for(it=mMeshBVHs.begin(); it!=mMeshBVHs.end(); it++)
+        delete it->second;
+    
+    mMeshBVHs.clear();
+}
+//----------------------------------------------------------------------------
+bool DotScene::raycast(const Ray& ray, DotSceneRaycastHit& hit, uint32 queryMask/*=0xFFFFFFFF*/)
+{
+    RayList rays(1, ray);
+    DotSceneRaycastHitList hits;
+    
+    raycast(rays, hits, queryMask);
+    hit = hits[0];
+    
+    return (0 != hit.mEntity);
+}
+//----------------------------------------------------------------------------
+size_t DotScene::raycast(const RayList& rays, DotSceneRaycastHitList& hits, uint32 queryMask/*=0xFFFFFFFF*/)
+{
+    hits.assign(rays.size(), DotSceneRaycastHit());
+    
+    //Closest distance found for each ray (world units)
+    std::vector<Real> distances(rays.size(), Math::POS_INFINITY);
+    
+    //Candidate rays by entity (broadphase)
+    std::vector<size_t> candidates;
+    candidates.reserve(rays.size());
+    
+    DotSceneStringVector* lists[] = { &mDynamicEntities, &mStaticEntities };
+    for(int l=0; l<2; l++)
+    {
+        for(DotSceneStringVector::iterator it=lists[l]->begin(); it!=lists[l]->end(); it++)
+        {
+            Entity* entity = mSceneMgr->getEntity(*it);
+            if (! entity->isInScene())
+                continue;
+            //batched entities are hidden but rendered by its static geometry
+            if ((! entity->isVisible()) && 
+                (! std::binary_search(mBatchedEntities.begin(), mBatchedEntities.end(), entity)))
+                continue;
+            if (! (entity->getQueryFlags() & queryMask))
+                continue;
+            
+            //Broadphase: world bounding box against every ray
+            const AxisAlignedBox& bounds = entity->getWorldBoundingBox(true);
+            candidates.clear();
+            for(size_t i=0; i<rays.size(); i++)
+            {
+                std::pair<bool, Real> rst = rays[i].intersects(bounds);
+                if ((rst.first) && (rst.second < distances[i]))
+                    candidates.push_back(i);
+            }
+            
+            if (candidates.empty())
+                continue;
+            
+            //Narrowphase: mesh local space, packets of rays
+            DotSceneMeshBVH* bvh = getMeshBVH(entity->getMesh());
+            Matrix4 toLocal = entity->getParentNode()->_getFullTransform().inverseAffine();
+            Matrix3 toLocalLinear;
+            toLocal.extract3x3Matrix(toLocalLinear);
+            
+            for(size_t c=0; c<candidates.size(); c+=BVH_RAY_PACKET_SIZE)
+            {
+                Ray packet[BVH_RAY_PACKET_SIZE];
+                Real distance[BVH_RAY_PACKET_SIZE];
+                unsigned int subMesh[BVH_RAY_PACKET_SIZE];
+                unsigned int triangle[BVH_RAY_PACKET_SIZE];
+                
+                size_t count = std::min<size_t>(BVH_RAY_PACKET_SIZE, candidates.size() - c);
+                for(size_t i=0; i<count; i++)
+                {
+                    //Not normalized: local distance == world distance
+                    const Ray& ray = rays[candidates[c + i]];
+                    packet[i].setOrigin(toLocal.transformAffine(ray.getOrigin()));
+                    packet[i].setDirection(toLocalLinear * ray.getDirection());
+                    distance[i] = distances[candidates[c + i]];
+                }
+                
+                int mask = bvh->intersect(packet, count, distance, subMesh, triangle);
+                for(size_t i=0; i<count; i++)
+                {
+                    if (! (mask & (1 << i)))
+                        continue;
+                    
+                    DotSceneRaycastHit& hit = hits[candidates[c + i]];
+                    hit.mEntity = entity;
+                    hit.mSubEntity = subMesh[i];
+                    hit.mTriangle = triangle[i];
+                    hit.mDistance = distance[i];
+                    distances[candidates[c + i]] = distance[i];
+                }
+            }
+        }
+    }
+    
+    size_t count = 0;
+    for(size_t i=0; i<hits.size(); i++)
+    {
+        if (hits[i].mEntity) count++;
+    }
+    
+    return count;
+}
+//----------------------------------------------------------------------------
+void DotScene::showBoundingBoxes()
+{
+    for(DotSceneStringVector::iterator it=mSceneNodes.begin(); it!=mSceneNodes.end(); it++)
+    {
+        SceneNode* node = mSceneMgr->getSceneNode(*it);
+        node->showBoundingBox(true);
+    }
+}
+//----------------------------------------------------------------------------
+void DotScene::hideBoundingBoxes()
+{
+    for(DotSceneStringVector::iterator it=mSceneNodes.begin(); it!=mSceneNodes.end(); it++)
+    {
+        SceneNode* node = mSceneMgr->getSceneNode(*it);
+        node->showBoundingBox(false);
+    }
+}
+
+//----------------------------------------------------------------------------
+void DotScene::showSkeletons()
+{
+    for(DotSceneStringVector::iterator it=mDynamicEntities.begin(); it!=mDynamicEntities.end(); it++)
+    {
+        Entity* entity = mSceneMgr->getEntity(*it);
+        if (entity->hasSkeleton()) entity->setDisplaySkeleton(true);
+    }
+}
+//----------------------------------------------------------------------------
+void DotScene::hideSkeletons()
+{
+    for(DotSceneStringVector::iterator it=mDynamicEntities.begin(); it!=mDynamicEntities.end(); it++)
+    {
+        Entity* entity = mSceneMgr->getEntity(*it);
+        if (entity->hasSkeleton()) entity->setDisplaySkeleton(true);
+    }
+}
+//----------------------------------------------------------------------------
+DotSceneAllocationStats DotScene::getAllocationStats() const
+{
+    return mArena->getStats();
+}
+//----------------------------------------------------------------------------
+bool DotScene::exportToFile(const String& filename/*=StringUtil::BLANK*/)
+{
+    TRACE_FUNC();
+    
+    if (! helper) 
+        helper = new DotScenePersistenceHelper(this);
+    
+    return helper->persist(filename);
+}
+
+/*****************************************************************************/
+/** DotScenePersistenceHelper (implementation)                               */                   
+/*****************************************************************************/
+DotScenePersistenceHelper::DotScenePersistenceHelper(DotScene* scene)
+    :mScene(scene)
+{
+    assert(scene);
+}
+//----------------------------------------------------------------------------
+DotScenePersistenceHelper::~DotScenePersistenceHelper()
+{
+    mScene = 0;
+}
+//----------------------------------------------------------------------------
+bool DotScenePersistenceHelper::persist(const String& filename/*=StringUtil::BLANK*/)
+{
+    TRACE_FUNC();
+    
+    //Source document: prefabs & instance references are written back as authored
+    DotSceneManager* manager = static_cast<DotSceneManager*>(mScene->getCreator());
+    TiXmlDocument* source = manager->_acquireDocument(mScene->mFile, mScene->mGroup);
+    if (! source)
+        return false;
+    
+    TiXmlDocument doc(*source);
+    manager->_releaseDocument(mScene->mFile, mScene->mGroup);
+    
+    //Instances keep its reference: only its transform overrides are updated
+    TiXmlElement* nodes = (doc.RootElement())? doc.RootElement()->FirstChildElement("nodes"): 0;
+    if (nodes)
+        persistInstances(nodes);
+    
+    //Scene file is a resource name: overwritten only if it lives in a file system archive
+    String file = filename;
+    if (StringUtil::BLANK == file)
+    {
+        FileInfoListPtr infos = ResourceGroupManager::getSingletonPtr()->findResourceFileInfo(mScene->mGroup, mScene->mFile);
+        if ((infos.isNull()) || (infos->empty()) || (! infos->front().archive) || 
+            ("FileSystem" != infos->front().archive->getType()))
+        {
+            log("Error: .dotscene file " + mScene->mFile + " is not in a file system archive, export needs a file name");
+            return false;
+        }
+        file = infos->front().archive->getName() + "/" + infos->front().filename;
+    }
+    
+    if (! doc.SaveFile(file.c_str()))
+    {
+        log("Error saving .dotscene file " + file);
+        return false;
+    }
+    
+    return true;
+}
+//----------------------------------------------------------------------------
+void DotScenePersistenceHelper::persistInstances(TiXmlElement* node)
+{
+    for(TiXmlElement* elem=node->FirstChildElement(); elem; elem=elem->NextSiblingElement())
+    {
+        String type = elem->Value();
+        if ("node" == type)
+        {
+            persistInstances(elem);
+        }
+        else if ("instance" == type)
+        {
+            //unnamed instances get a generated name at load
+            String name = mScene->getAttrib(elem, "name");
+            SceneNode* sceneNode = (StringUtil::BLANK == name)? 0: mScene->getSceneNode(mScene->mPrefix + name);
+            if (sceneNode)
+                persistTransform(elem, sceneNode);
+        }
+    }
+}
+//----------------------------------------------------------------------------
+void DotScenePersistenceHelper::persistTransform(TiXmlElement* node, SceneNode* sceneNode)
+{
+    const char* names[] = {"position", "rotation", "quaternion", "scale"};
+    for(int i=0; i<4; i++)
+    {
+        TiXmlElement* elem = node->FirstChildElement(names[i]);
+        while (elem)
+        {
+            node->RemoveChild(elem);
+            elem = node->FirstChildElement(names[i]);
+        }
+    }
+    
+    Vector3 position = sceneNode->getPosition() / (Real)mScene->mUnitConversionFactor;
+    TiXmlElement positionElem("position");
+    positionElem.SetDoubleAttribute("x", position.x);
+    positionElem.SetDoubleAttribute("y", position.y);
+    positionElem.SetDoubleAttribute("z", position.z);
+    node->InsertEndChild(positionElem);
+    
+    const Quaternion& orientation = sceneNode->getOrientation();
+    TiXmlElement rotationElem("rotation");
+    rotationElem.SetDoubleAttribute("qw", orientation.w);
+    rotationElem.SetDoubleAttribute("qx", orientation.x);
+    rotationElem.SetDoubleAttribute("qy", orientation.y);
+    rotationElem.SetDoubleAttribute("qz", orientation.z);
+    node->InsertEndChild(rotationElem);
+    
+    const Vector3& scale = sceneNode->getScale();
+    TiXmlElement scaleElem("scale");
+    scaleElem.SetDoubleAttribute("x", scale.x);
+    scaleElem.SetDoubleAttribute("y", scale.y);
+    scaleElem.SetDoubleAttribute("z", scale.z);
+    node->InsertEndChild(scaleElem);
+}
+
+/*****************************************************************************/
+/** DotSceneString (implementation)                                          */                   
+/*****************************************************************************/
+DotSceneStringPool& DotSceneStringPool::getSingleton()
+{
+    static DotSceneStringPool pool;
+    return pool;
+}
+//----------------------------------------------------------------------------
+const DotSceneStringEntry DotSceneStringPool::msBlank("");
+//----------------------------------------------------------------------------
+size_t DotSceneStringPool::entryMemory(const DotSceneStringEntry& entry)
+{
+    //entry, bucket & heap string (if not stored in place)
+    return sizeof(DotSceneStringEntry) + 2 * sizeof(void*) + entry.mString.capacity() + 1;
+}
+//----------------------------------------------------------------------------
+const DotSceneStringEntry* DotSceneStringPool::acquire(const String& str)
+{
+    if (str.empty())
+        return &msBlank;
+    
+    boost::mutex::scoped_lock lock(mMutex);
+    
+    PoolType::iterator it = mPool.find(str, DotSceneStringHash(), DotSceneStringEqual());
+    if (mPool.end() == it)
+    {
+        it = mPool.insert(DotSceneStringEntry(str)).first;
+        mMemory += entryMemory(*it);
+    }
+    
+    ++it->mRefs;
+    return &(*it);
+}
+//----------------------------------------------------------------------------
+const DotSceneStringEntry* DotSceneStringPool::find(const String& str)
+{
+    if (str.empty())
+        return &msBlank;
+    
+    boost::mutex::scoped_lock lock(mMutex);
+    
+    PoolType::iterator it = mPool.find(str, DotSceneStringHash(), DotSceneStringEqual());
+    if (mPool.end() == it)
+        return 0;
+    
+    ++it->mRefs;
+    return &(*it);
+}
+//----------------------------------------------------------------------------
+const DotSceneStringEntry* DotSceneStringPool::lookup(const String& str)
+{
+    if (str.empty())
+        return &msBlank;
+    
+    boost::mutex::scoped_lock lock(mMutex);
+    
+    PoolType::iterator it = mPool.find(str, DotSceneStringHash(), DotSceneStringEqual());
+    return (mPool.end() != it)? &(*it): 0;
+}
+//----------------------------------------------------------------------------
+void DotSceneStringPool::addRef(const DotSceneStringEntry* entry)
+{
+    if (&msBlank == entry)
+        return;
+    
+#if OGRE_THREAD_SUPPORT
+    ++entry->mRefs;
+#else
+    //AtomicScalar is a plain integer without Ogre thread support
+    boost::mutex::scoped_lock lock(mMutex);
+    ++entry->mRefs;
+#endif
+}
+//----------------------------------------------------------------------------
+void DotSceneStringPool::release(const DotSceneStringEntry* entry)
+{
+    if (&msBlank == entry)
+        return;
+    
+#if OGRE_THREAD_SUPPORT
+    //Fast path: not last reference, entry can't be erased by others
+    uint32 refs = entry->mRefs.get();
+    while (refs > 1)
+    {
+        if (entry->mRefs.cas(refs, refs - 1))
+            return;
+        refs = entry->mRefs.get();
+    }
+#endif
+    
+    //Last reference: new handles are created under lock
+    boost::mutex::scoped_lock lock(mMutex);
+    if (0 != --entry->mRefs)
+        return;
+    
+    mMemory -= entryMemory(*entry);
+    mPool.erase(mPool.find(entry->mString, DotSceneStringHash(), DotSceneStringEqual()));
+}
+//----------------------------------------------------------------------------
+size_t DotSceneStringPool::size()
+{
+    boost::mutex::scoped_lock lock(mMutex);
+    return mPool.size();
+}
+//----------------------------------------------------------------------------
+size_t DotSceneStringPool::memory()
+{
+    boost::mutex::scoped_lock lock(mMutex);
+    return mMemory + mPool.bucket_count() * sizeof(void*);
+}
+//----------------------------------------------------------------------------
+DotSceneString::DotSceneString()
+              :mEntry(DotSceneStringPool::blank())
+{
+}
+//----------------------------------------------------------------------------
+DotSceneString::DotSceneString(const String& str)
+              :mEntry(DotSceneStringPool::getSingleton().acquire(str))
+{
+}
+//----------------------------------------------------------------------------
+DotSceneString::DotSceneString(const char* str)
+              :mEntry(DotSceneStringPool::getSingleton().acquire(String(str)))
+{
+}
+//----------------------------------------------------------------------------
+DotSceneString::DotSceneString(const DotSceneString& other)
+              :mEntry(other.mEntry)
+{
+    DotSceneStringPool::getSingleton().addRef(mEntry);
+}
+//----------------------------------------------------------------------------
+DotSceneString::~DotSceneString()
+{
+    DotSceneStringPool::getSingleton().release(mEntry);
+}
+//----------------------------------------------------------------------------
+DotSceneString& DotSceneString::operator=(const DotSceneString& other)
+{
+    if (mEntry != other.mEntry)
+    {
+        DotSceneStringPool::getSingleton().addRef(other.mEntry);
+        DotSceneStringPool::getSingleton().release(mEntry);
+        mEntry = other.mEntry;
+    }
+    
+    return *this;
+}
+//----------------------------------------------------------------------------
+const String& DotSceneString::str() const
+{
+    return mEntry->mString;
+}
+//----------------------------------------------------------------------------
+bool DotSceneString::find(const String& str, DotSceneString& handle)
+{
+    const DotSceneStringEntry* entry = DotSceneStringPool::getSingleton().find(str);
+    if (! entry)
+        return false;
+    
+    DotSceneStringPool::getSingleton().release(handle.mEntry);
+    handle.mEntry = entry;
+    
+    return true;
+}
+//----------------------------------------------------------------------------
+const DotSceneStringEntry* DotSceneString::find(const String& str)
+{
+    return DotSceneStringPool::getSingleton().lookup(str);
+}
+//----------------------------------------------------------------------------
+size_t DotSceneString::getPoolSize()
+{
+    return DotSceneStringPool::getSingleton().size();
+}
+//----------------------------------------------------------------------------
+size_t DotSceneString::getPoolMemory()
+{
+    return DotSceneStringPool::getSingleton().memory();
+}
+
+/*****************************************************************************/
+/** DotSceneArena (implementation)                                           */                   
+/*****************************************************************************/
+DotSceneArena::DotSceneArena(size_t blockSize/*=ARENA_BLOCK_SIZE*/)
+             :mBlockSize(blockSize), mCurrent(0)
+{
+}
+//----------------------------------------------------------------------------
+DotSceneArena::~DotSceneArena()
+{
+    release();
+    
+    for(std::vector<BlockType>::iterator it=mBlocks.begin(); it!=mBlocks.end(); it++)
+        OGRE_FREE_SIMD(it->mData, MEMCATEGORY_SCENE_CONTROL);
+    mBlocks.clear();
+}
+//----------------------------------------------------------------------------
+void* DotSceneArena::allocate(size_t size)
+{
+    size = (size + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+    
+    //Find room in current or next reusable block
+    while (mCurrent < mBlocks.size())
+    {
+        BlockType& block = mBlocks[mCurrent];
+        if (block.mOffset + size <= block.mSize)
+        {
+            void* ptr = block.mData + block.mOffset;
+            block.mOffset += size;
+            
+            mStats.mBytesInUse += size;
+            mStats.mAllocations++;
+            return ptr;
+        }
+        mCurrent++;
+    }
+    
+    //Request a new block to the system
+    BlockType block;
+    block.mSize = std::max(size, mBlockSize);
+    block.mData = static_cast<unsigned char*>(OGRE_MALLOC_SIMD(block.mSize, MEMCATEGORY_SCENE_CONTROL));
+    block.mOffset = size;
+    mBlocks.push_back(block);
+    mCurrent = mBlocks.size() - 1;
+    
+    mStats.mBytesReserved += block.mSize;
+    mStats.mBytesInUse += size;
+    mStats.mAllocations++;
+    mStats.mBlockAllocations++;
+    
+    return block.mData;
+}
+//----------------------------------------------------------------------------
+void DotSceneArena::release()
+{
+    //Destroy in reverse construction order
+    for(size_t i=mObjects.size(); i>0; i--)
+        mObjects[i - 1].second(mObjects[i - 1].first);
+    mObjects.clear();
+    
+    for(std::vector<BlockType>::iterator it=mBlocks.begin(); it!=mBlocks.end(); it++)
+        it->mOffset = 0;
+    mCurrent = 0;
+    
+    mStats.mBytesInUse = 0;
+    mStats.mReleases++;
+}
+//----------------------------------------------------------------------------
+const DotSceneAllocationStats& DotSceneArena::getStats() const
+{
+    //live objects are counted on demand
+    const_cast<DotSceneAllocationStats&>(mStats).mObjects = mObjects.size();
+    return mStats;
+}
+
+/*****************************************************************************/
+/** DotSceneMeshBVH (implementation)                                         */                   
+/*****************************************************************************/
+DotSceneMeshBVH::DotSceneMeshBVH(const MeshPtr& mesh)
+{
+    TRACE_FUNC();
+    assert(! mesh.isNull());
+    
+    //Read triangle lists from vertex & index buffers
+    for(unsigned short s=0; s<mesh->getNumSubMeshes(); s++)
+    {
+        SubMesh* submesh = mesh->getSubMesh(s);
+        VertexData* vertexData = (submesh->useSharedVertices)? mesh->sharedVertexData: submesh->vertexData;
+        IndexData* indexData = submesh->indexData;
+        
+        if ((! vertexData) || (! indexData) || (! indexData->indexCount))
+            continue;
+        if (RenderOperation::OT_TRIANGLE_LIST != submesh->operationType)
+            continue;
+        
+        const VertexElement* element = vertexData->vertexDeclaration->findElementBySemantic(VES_POSITION);
+        HardwareVertexBufferSharedPtr vbuffer = vertexData->vertexBufferBinding->getBuffer(element->getSource());
+        HardwareIndexBufferSharedPtr ibuffer = indexData->indexBuffer;
+        
+        //Write only buffers without shadow copy can't be read back
+        if (((vbuffer->getUsage() & HardwareBuffer::HBU_WRITE_ONLY) && (! vbuffer->hasShadowBuffer())) ||
+            ((ibuffer->getUsage() & HardwareBuffer::HBU_WRITE_ONLY) && (! ibuffer->hasShadowBuffer())))
+        {
+            log("Warning: Submesh " + stringify((int)s) + " of mesh " + mesh->getName() + 
+                " has write only buffers without shadow copy, ray queries skip it");
+            continue;
+        }
+        
+        size_t vertexSize = vbuffer->getVertexSize();
+        unsigned char* vertices = static_cast<unsigned char*>(vbuffer->lock(HardwareBuffer::HBL_READ_ONLY));
+        vertices += vertexData->vertexStart * vertexSize;
+        
+        bool use32 = (HardwareIndexBuffer::IT_32BIT == ibuffer->getType());
+        unsigned char* indices = static_cast<unsigned char*>(ibuffer->lock(HardwareBuffer::HBL_READ_ONLY));
+        indices += indexData->indexStart * ibuffer->getIndexSize();
+        
+        for(size_t t=0; t+2<indexData->indexCount; t+=3)
+        {
+            Vector3 v[3];
+            for(int k=0; k<3; k++)
+            {
+                size_t idx = (use32)? reinterpret_cast<uint32*>(indices)[t + k]:
+                                      reinterpret_cast<uint16*>(indices)[t + k];
+                float* position = 0;
+                element->baseVertexPointerToElement(vertices + idx * vertexSize, &position);
+                v[k] = Vector3(position[0], position[1], position[2]);
+            }
+            
+            Vector3 e1 = v[1] - v[0];
+            Vector3 e2 = v[2] - v[0];
+            float data[9] = { (float)v[0].x, (float)v[0].y, (float)v[0].z, 
+                              (float)e1.x, (float)e1.y, (float)e1.z, 
+                              (float)e2.x, (float)e2.y, (float)e2.z };
+            mTriangles.insert(mTriangles.end(), data, data + 9);
+            mCentroids.push_back((v[0] + v[1] + v[2]) / 3.0f);
+            mSubMesh.push_back(s);
+            mIndex.push_back((uint32)(t / 3));
+        }
+        
+        ibuffer->unlock();
+        vbuffer->unlock();
+    }
+    
+    //Build hierarchy
+    uint32 count = (uint32)mCentroids.size();
+    mOrder.resize(count);
+    for(uint32 i=0; i<count; i++)
+        mOrder[i] = i;
+    
+    mNodes.reserve(2 * count / BVH_MAX_LEAF_TRIANGLES + 1);
+    if (count)
+        build(0, count, 0);
+    
+    //Reorder triangle data by leaf order & release build data
+    std::vector<float> triangles(mTriangles.size());
+    std::vector<uint32> subMeshes(count), indexes(count);
+    for(uint32 i=0; i<count; i++)
+    {
+        std::copy(&mTriangles[mOrder[i] * 9], &mTriangles[mOrder[i] * 9] + 9, &triangles[i * 9]);
+        subMeshes[i] = mSubMesh[mOrder[i]];
+        indexes[i] = mIndex[mOrder[i]];
+    }
+    mTriangles.swap(triangles);
+    mSubMesh.swap(subMeshes);
+    mIndex.swap(indexes);
+    
+    std::vector<Vector3>().swap(mCentroids);
+    std::vector<uint32>().swap(mOrder);
+    
+    log("[DotScene] Ray query accelerator for mesh " + mesh->getName() + ": " + 
+        stringify((int)count) + " triangles, " + stringify((int)mNodes.size()) + " nodes");
+}
+//----------------------------------------------------------------------------
+/** Functor: sort triangles by centroid along an axis */
+struct DotSceneCentroidLess
+{
+    const std::vector<Vector3>& mCentroids;
+    int mAxis;
+    
+    DotSceneCentroidLess(const std::vector<Vector3>& centroids, int axis)
+                        :mCentroids(centroids), mAxis(axis) {}
+    bool operator()(uint32 a, uint32 b) const 
+    { 
+        return mCentroids[a][mAxis] < mCentroids[b][mAxis]; 
+    }
+};
+//----------------------------------------------------------------------------
+uint32 DotSceneMeshBVH::build(uint32 start, uint32 count, int depth)
+{
+    uint32 index = (uint32)mNodes.size();
+    mNodes.push_back(NodeType());
+    
+    //Bounds of triangles & centroids
+    AxisAlignedBox bounds, centroids;
+    for(uint32 i=start; i<start+count; i++)
+    {
+        const float* t = &mTriangles[mOrder[i] * 9];
+        Vector3 v0(t[0], t[1], t[2]);
+        bounds.merge(v0);
+        bounds.merge(v0 + Vector3(t[3], t[4], t[5]));
+        bounds.merge(v0 + Vector3(t[6], t[7], t[8]));
+        centroids.merge(mCentroids[mOrder[i]]);
+    }
+    
+    for(int k=0; k<3; k++)
+    {
+        mNodes[index].mMin[k] = bounds.getMinimum()[k];
+        mNodes[index].mMax[k] = bounds.getMaximum()[k];
+    }
+    
+    //Leaf node
+    if ((count <= BVH_MAX_LEAF_TRIANGLES) || (depth >= BVH_MAX_DEPTH - 1))
+    {
+        mNodes[index].mStart = start;
+        mNodes[index].mCount = count;
+        mNodes[index].mRight = 0;
+        return index;
+    }
+    
+    //Split by median along longest centroid axis
+    Vector3 extent = centroids.getMaximum() - centroids.getMinimum();
+    int axis = 0;
+    if (extent.y > extent[axis]) axis = 1;
+    if (extent.z > extent[axis]) axis = 2;
+    
+    uint32 half = count / 2;
+    std::nth_element(mOrder.begin() + start, mOrder.begin() + start + half, 
+                     mOrder.begin() + start + count, DotSceneCentroidLess(mCentroids, axis));
+    
+    build(start, half, depth + 1);
+    uint32 right = build(start + half, count - half, depth + 1);
+    
+    mNodes[index].mStart = 0;
+    mNodes[index].mCount = 0;
+    mNodes[index].mRight = right;
+    return index;
+}
+//----------------------------------------------------------------------------
+int DotSceneMeshBVH::intersectBounds(const NodeType& node, const RayPacketType& packet) const
+{
+#if DOTSCENE_USE_SSE
+    //Slab test for the whole packet at once
+    __m128 tmin = _mm_setzero_ps();
+    __m128 tmax = _mm_loadu_ps(packet.mDistance);
+    for(int k=0; k<3; k++)
+    {
+        __m128 origin = _mm_loadu_ps(packet.mOrigin[k]);
+        __m128 inverse = _mm_loadu_ps(packet.mInvDirection[k]);
+        __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.mMin[k]), origin), inverse);
+        __m128 t2 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.mMax[k]), origin), inverse);
+        tmin = _mm_max_ps(tmin, _mm_min_ps(t1, t2));
+        tmax = _mm_min_ps(tmax, _mm_max_ps(t1, t2));
+    }
+    return _mm_movemask_ps(_mm_cmple_ps(tmin, tmax)) & packet.mActive;
+#else
+    int mask = 0;
+    for(int i=0; i<BVH_RAY_PACKET_SIZE; i++)
+    {
+        if (! (packet.mActive & (1 << i)))
+            continue;
+        
+        float tmin = 0, tmax = packet.mDistance[i];
+        for(int k=0; k<3; k++)
+        {
+            float t1 = (node.mMin[k] - packet.mOrigin[k][i]) * packet.mInvDirection[k][i];
+            float t2 = (node.mMax[k] - packet.mOrigin[k][i]) * packet.mInvDirection[k][i];
+            tmin = std::max(tmin, std::min(t1, t2));
+            tmax = std::min(tmax, std::max(t1, t2));
+        }
+        if (tmin <= tmax)
+            mask |= (1 << i);
+    }
+    return mask;
+#endif
+}
+//----------------------------------------------------------------------------
+Real DotSceneMeshBVH::intersectTriangle(uint32 triangle, const Ray& ray) const
+{
+    const float* t = &mTriangles[triangle * 9];
+    Vector3 v0(t[0], t[1], t[2]), e1(t[3], t[4], t[5]), e2(t[6], t[7], t[8]);
+    
+    const Vector3& direction = ray.getDirection();
+    Vector3 p = direction.crossProduct(e2);
+    Real det = e1.dotProduct(p);
+    if (Math::Abs(det) < std::numeric_limits<Real>::epsilon())
+        return -1;
+    
+    Real inverse = 1.0f / det;
+    Vector3 s = ray.getOrigin() - v0;
+    Real u = s.dotProduct(p) * inverse;
+    if ((u < 0) || (u > 1))
+        return -1;
+    
+    Vector3 q = s.crossProduct(e1);
+    Real v = direction.dotProduct(q) * inverse;
+    if ((v < 0) || (u + v > 1))
+        return -1;
+    
+    return e2.dotProduct(q) * inverse;
+}
+//----------------------------------------------------------------------------
+int DotSceneMeshBVH::intersect(const Ray* rays, size_t count, Real* distance, 
+                               unsigned int* subMesh, unsigned int* triangle) const
+{
+    assert(count <= BVH_RAY_PACKET_SIZE);
+    
+    if (mNodes.empty())
+        return 0;
+    
+    RayPacketType packet;
+    packet.mActive = 0;
+    for(int i=0; i<BVH_RAY_PACKET_SIZE; i++)
+    {
+        //Unused lanes are never active
+        size_t r = std::min<size_t>(i, count - 1);
+        for(int k=0; k<3; k++)
+        {
+            packet.mOrigin[k][i] = (float)rays[r].getOrigin()[k];
+            packet.mInvDirection[k][i] = (float)(1.0f / rays[r].getDirection()[k]);
+        }
+        packet.mDistance[i] = (float)std::min<Real>(distance[r], std::numeric_limits<float>::max());
+        if ((size_t)i < count)
+            packet.mActive |= (1 << i);
+    }
+    
+    int hits = 0;
+    uint32 stack[2 * BVH_MAX_DEPTH];
+    int top = 0;
+    stack[top++] = 0;
+    
+    while (top)
+    {
+        const NodeType& node = mNodes[stack[--top]];
+        int mask = intersectBounds(node, packet);
+        if (! mask)
+            continue;
+        
+        if (! node.mCount)
+        {
+            //Left child follows its parent
+            stack[top++] = node.mRight;
+            stack[top++] = (uint32)(&node - &mNodes[0]) + 1;
+            continue;
+        }
+        
+        for(uint32 t=node.mStart; t<node.mStart+node.mCount; t++)
+        {
+            for(size_t i=0; i<count; i++)
+            {
+                if (! (mask & (1 << i)))
+                    continue;
+                
+                Real d = intersectTriangle(t, rays[i]);
+                if ((d >= 0) && (d < packet.mDistance[i]))
+                {
+                    packet.mDistance[i] = (float)d;
+                    distance[i] = d;
+                    subMesh[i] = mSubMesh[t];
+                    triangle[i] = mIndex[t];
+                    hits |= (1 << i);
+                }
+            }
+        }
+    }
+    
+    return hits;
+}
+//----------------------------------------------------------------------------
+size_t DotSceneMeshBVH::getMemoryUsage() const
+{
+    return sizeof(DotSceneMeshBVH) + 
+           mNodes.capacity() * sizeof(NodeType) + 
+           mTriangles.capacity() * sizeof(float) + 
+           mSubMesh.capacity() * sizeof(uint32) + 
+           mIndex.capacity() * sizeof(uint32);
+}
+
+/*****************************************************************************/
+/** DotSceneUpdatePool (implementation)                                      */                   
+/*****************************************************************************/
+DotSceneUpdatePool::DotSceneUpdatePool(size_t threads)
+                   :mScenes(0), mDelta(0), mNext(0), mPending(0), mGeneration(0), mQuit(false)
+{
+    for(size_t i=0; i<threads; i++)
+        mThreads.create_thread(boost::bind(&DotSceneUpdatePool::worker, this));
+}
+//----------------------------------------------------------------------------
+DotSceneUpdatePool::~DotSceneUpdatePool()
+{
+    {
+        boost::mutex::scoped_lock lock(mMutex);
+        mQuit = true;
+    }
+    mWake.notify_all();
+    mThreads.join_all();
+}
+//----------------------------------------------------------------------------
+void DotSceneUpdatePool::run(const std::vector<DotScene*>& scenes, Real delta)
+{
+    {
+        boost::mutex::scoped_lock lock(mMutex);
+        mScenes = &scenes;
+        mDelta = delta;
+        mNext = 0;
+        mPending = scenes.size();
+        mGeneration++;
+    }
+    mWake.notify_all();
+    
+    drain();
+    
+    boost::mutex::scoped_lock lock(mMutex);
+    while (mPending)
+        mDone.wait(lock);
+    mScenes = 0;
+}
+//----------------------------------------------------------------------------
+size_t DotSceneUpdatePool::getThreadCount() const
+{
+    return mThreads.size();
+}
+//----------------------------------------------------------------------------
+void DotSceneUpdatePool::worker()
+{
+    unsigned long generation = 0;
+    while (true)
+    {
+        {
+            boost::mutex::scoped_lock lock(mMutex);
+            while ((! mQuit) && (generation == mGeneration))
+                mWake.wait(lock);
+            if (mQuit)
+                return;
+            generation = mGeneration;
+        }
+        drain();
+    }
+}
+//----------------------------------------------------------------------------
+void DotSceneUpdatePool::drain()
+{
+    while (true)
+    {
+        DotScene* scene = 0;
+        Real delta = 0;
+        {
+            boost::mutex::scoped_lock lock(mMutex);
+            if ((! mScenes) || (mNext >= mScenes->size()))
+                return;
+            scene = (*mScenes)[mNext++];
+            delta = mDelta;
+        }
+        
+        scene->_prepareUpdate(delta);
+        
+        boost::mutex::scoped_lock lock(mMutex);
+        if (0 == --mPending)
+            mDone.notify_all();
+    }
+}
+
+/*****************************************************************************/
+/** DotSceneBoundsCache (implementation)                                     */                   
+/*****************************************************************************/
+DotSceneBoundsCache::DotSceneBoundsCache(DotScene* scene)
+    :mScene(scene)
+{
+}
+//----------------------------------------------------------------------------
+DotSceneBoundsCache::~DotSceneBoundsCache()
+{
+    clear();
+}
+//----------------------------------------------------------------------------
+bool DotSceneBoundsCache::track(SceneNode* root)
+{
+    assert(root);
+    
+    //Single listener by node: nodes listened by application (before or after us) aren't cached
+    if ((root->getListener()) && (this != root->getListener()))
+    {
+        std::map<const Node*, EntryType>::iterator it = mEntries.find(root);
+        if (mEntries.end() != it)
+        {
+            mEntries.erase(it);
+            invalidate(root->getParent());
+        }
+        
+        SceneNode::ChildNodeIterator it_child = root->getChildIterator();
+        while (it_child.hasMoreElements())
+            track(static_cast<SceneNode*>(it_child.getNext()));
+        return false;
+    }
+    
+    //Nodes created after last track: its parent doesn't know them
+    std::map<const Node*, EntryType>::iterator it = mEntries.find(root);
+    if (mEntries.end() == it)
+    {
+        root->setListener(this);
+        
+        EntryType entry;
+        entry.mParent = root->getParent();
+        entry.mDirty = true;
+        entry.mVolatile = false;
+        it = mEntries.insert(std::make_pair(root, entry)).first;
+        invalidate(entry.mParent);
+    }
+    
+    bool listened = true;
+    SceneNode::ChildNodeIterator it_child = root->getChildIterator();
+    while (it_child.hasMoreElements())
+    {
+        if (! track(static_cast<SceneNode*>(it_child.getNext())))
+            listened = false;
+    }
+    it->second.mVolatile = ! listened;
+    
+    return listened;
+}
+//----------------------------------------------------------------------------
+void DotSceneBoundsCache::clear()
+{
+    for(std::map<const Node*, EntryType>::iterator it=mEntries.begin(); it!=mEntries.end(); it++)
+    {
+        Node* node = const_cast<Node*>(it->first);
+        if (this == node->getListener())
+            node->setListener(0);
+    }
+    mEntries.clear();
+}
+//----------------------------------------------------------------------------
+const AxisAlignedBox& DotSceneBoundsCache::getBounds(SceneNode* node)
+{
+    assert(node);
+    
+    std::map<const Node*, EntryType>::iterator it = mEntries.find(node);
+    if (mEntries.end() == it)
+    {
+        mUncached = computeBounds(node);
+        return mUncached;
+    }
+    
+    //Nothing moved in subtree: O(1)
+    EntryType& entry = it->second;
+    if ((entry.mDirty) || (entry.mVolatile))
+    {
+        entry.mBounds = computeBounds(node);
+        entry.mDirty = false;
+    }
+    return entry.mBounds;
+}
+//----------------------------------------------------------------------------
+AxisAlignedBox DotSceneBoundsCache::computeBounds(SceneNode* node)
+{
+    AxisAlignedBox bounds;
+    
+    //Renderable objects only: camera bounds are its frustum, light bounds its range
+    SceneNode::ObjectIterator it_object = node->getAttachedObjectIterator();
+    while (it_object.hasMoreElements())
+    {
+        MovableObject* object = it_object.getNext();
+        if (object->getTypeFlags() & (SceneManager::FRUSTUM_TYPE_MASK | SceneManager::LIGHT_TYPE_MASK))
+            continue;
+        
+        const AxisAlignedBox& box = object->getWorldBoundingBox(true);
+        if (box.isFinite())
+            bounds.merge(box);
+    }
+    
+    SceneNode::ChildNodeIterator it_child = node->getChildIterator();
+    while (it_child.hasMoreElements())
+    {
+        AxisAlignedBox box = getBounds(static_cast<SceneNode*>(it_child.getNext()));
+        if (box.isFinite())
+            bounds.merge(box);
+    }
+    
+    return bounds;
+}
+//----------------------------------------------------------------------------
+void DotSceneBoundsCache::invalidate(const Node* node)
+{
+    //Stops at first dirty node: its ancestors are already dirty
+    while (node)
+    {
+        std::map<const Node*, EntryType>::iterator it = mEntries.find(node);
+        if ((mEntries.end() == it) || (it->second.mDirty))
+            return;
+        
+        it->second.mDirty = true;
+        node = it->second.mParent;
+    }
+}
+//----------------------------------------------------------------------------
+size_t DotSceneBoundsCache::getMemoryUsage() const
+{
+    return sizeof(DotSceneBoundsCache) + 
+           mEntries.size() * (sizeof(const Node*) + sizeof(EntryType) + 4 * sizeof(void*));
+}
+//----------------------------------------------------------------------------
+void DotSceneBoundsCache::nodeUpdated(const Node* node)
+{
+    invalidate(node);
+}
+//----------------------------------------------------------------------------
+void DotSceneBoundsCache::nodeDestroyed(const Node* node)
+{
+    //Listener of scene nodes: handles are invalidated through it
+    mScene->_notifyNodeDestroyed(node);
+    
+    std::map<const Node*, EntryType>::iterator it = mEntries.find(node);
+    if (mEntries.end() == it)
+        return;
+    
+    const Node* parent = it->second.mParent;
+    mEntries.erase(it);
+    invalidate(parent);
+}
+//----------------------------------------------------------------------------
+void DotSceneBoundsCache::nodeAttached(const Node* node)
+{
+    std::map<const Node*, EntryType>::iterator it = mEntries.find(node);
+    if (mEntries.end() == it)
+        return;
+    
+    it->second.mParent = node->getParent();
+    it->second.mDirty = false;
+    invalidate(node);
+}
+//----------------------------------------------------------------------------
+void DotSceneBoundsCache::nodeDetached(const Node* node)
+{
+    std::map<const Node*, EntryType>::iterator it = mEntries.find(node);
+    if (mEntries.end() == it)
+        return;
+    
+    const Node* parent = it->second.mParent;
+    it->second.mParent = 0;
+    it->second.mDirty = true;
+    invalidate(parent);
+}
+
+/*****************************************************************************/
+/** DotSceneTransformSnapshot (implementation)                               */                   
+/*****************************************************************************/
+DotSceneTransformSnapshot::DotSceneTransformSnapshot()
+    :mSceneMgr(0),
+     mFront(0),
+     mSize(0)
+{
+    mSequence[0] = mSequence[1] = 0;
+    mFrames[0] = mFrames[1] = 0;
+}
+//----------------------------------------------------------------------------
+DotSceneTransformSnapshot::~DotSceneTransformSnapshot()
+{
+    clear();
+}
+//----------------------------------------------------------------------------
+void DotSceneTransformSnapshot::setNodes(SceneManager* sceneMgr, const std::vector<SceneNode*>& nodes, 
+                                         const std::vector<uint32>& keys)
+{
+    assert(sceneMgr);
+    assert(nodes.size() == keys.size());
+    clear();
+    
+    //Buffers sized once: publishing cost is bounded by nodes count (no allocations)
+    mNodes = nodes;
+    
+    //Slots chained by handle index: destroyed node finds its slots without scan
+    mNextSlots.assign(nodes.size(), nodes.size());
+    for(size_t i=nodes.size(); i>0; i--)
+    {
+        uint32 key = keys[i - 1];
+        if ((! nodes[i - 1]) || (key >= HANDLE_INDEX_MASK))
+            continue;
+        
+        if (key >= mFirstSlots.size())
+            mFirstSlots.resize(key + 1, nodes.size());
+        mNextSlots[i - 1] = mFirstSlots[key];
+        mFirstSlots[key] = i - 1;
+    }
+    
+    for(int b=0; b<2; b++)
+    {
+        BufferType& buffer = mBuffers[b];
+        buffer.mX.assign(nodes.size(), 0);
+        buffer.mY.assign(nodes.size(), 0);
+        buffer.mZ.assign(nodes.size(), 0);
+        buffer.mQw.assign(nodes.size(), 1);
+        buffer.mQx.assign(nodes.size(), 0);
+        buffer.mQy.assign(nodes.size(), 0);
+        buffer.mQz.assign(nodes.size(), 0);
+        mFrames[b] = 0;
+    }
+    mSize = nodes.size();
+    
+    mSceneMgr = sceneMgr;
+    mSceneMgr->addListener(this);
+}
+//----------------------------------------------------------------------------
+void DotSceneTransformSnapshot::clear()
+{
+    if (mSceneMgr)
+        mSceneMgr->removeListener(this);
+    mSceneMgr = 0;
+    mNodes.clear();
+    mFirstSlots.clear();
+    mNextSlots.clear();
+}
+//----------------------------------------------------------------------------
+void DotSceneTransformSnapshot::removeNode(uint32 key)
+{
+    if ((key >= mFirstSlots.size()) || (mFirstSlots[key] >= mNodes.size()))
+        return;
+    
+    //Last published transform copied to back buffer: readers see it whatever buffer they copy
+    int front = mFront;
+    int back = 1 - front;
+    const BufferType& source = mBuffers[front];
+    BufferType& buffer = mBuffers[back];
+    
+    mSequence[back]++;
+    DOTSCENE_MEMORY_BARRIER();
+    
+    for(size_t i=mFirstSlots[key]; i<mNodes.size(); i=mNextSlots[i])
+    {
+        mNodes[i] = 0;
+        buffer.mX[i] = source.mX[i];
+        buffer.mY[i] = source.mY[i];
+        buffer.mZ[i] = source.mZ[i];
+        buffer.mQw[i] = source.mQw[i];
+        buffer.mQx[i] = source.mQx[i];
+        buffer.mQy[i] = source.mQy[i];
+        buffer.mQz[i] = source.mQz[i];
+    }
+    mFirstSlots[key] = mNodes.size();
+    
+    DOTSCENE_MEMORY_BARRIER();
+    mSequence[back]++;
+}
+//----------------------------------------------------------------------------
+void DotSceneTransformSnapshot::publish(unsigned long frame)
+{
+    //Once by frame (listener is called by camera)
+    if ((mNodes.empty()) || (frame == mFrames[mFront]))
+        return;
+    
+    int back = 1 - mFront;
+    BufferType& buffer = mBuffers[back];
+    
+    mSequence[back]++;
+    DOTSCENE_MEMORY_BARRIER();
+    
+    for(size_t i=0; i<mNodes.size(); i++)
+    {
+        //Stale handles publish origin, destroyed nodes their last transform (same in both buffers)
+        if (! mNodes[i])
+            continue;
+        
+        const Vector3& position = mNodes[i]->_getDerivedPosition();
+        const Quaternion& orientation = mNodes[i]->_getDerivedOrientation();
+        buffer.mX[i] = position.x;
+        buffer.mY[i] = position.y;
+        buffer.mZ[i] = position.z;
+        buffer.mQw[i] = orientation.w;
+        buffer.mQx[i] = orientation.x;
+        buffer.mQy[i] = orientation.y;
+        buffer.mQz[i] = orientation.z;
+    }
+    mFrames[back] = frame;
+    
+    DOTSCENE_MEMORY_BARRIER();
+    mSequence[back]++;
+    DOTSCENE_MEMORY_BARRIER();
+    mFront = back;
+}
+//----------------------------------------------------------------------------
+bool DotSceneTransformSnapshot::read(std::vector<Vector3>& positions, std::vector<Quaternion>& orientations, 
+                                     unsigned long* frame) const
+{
+    //Retry only if publisher wrapped around to buffer being copied (reader slower than a frame)
+    for(int retry=0; retry<SNAPSHOT_READ_RETRIES; retry++)
+    {
+        int front = mFront;
+        DOTSCENE_MEMORY_BARRIER();
+        unsigned long sequence = mSequence[front];
+        if (sequence & 1)
+            continue;
+        DOTSCENE_MEMORY_BARRIER();
+        
+        unsigned long published = mFrames[front];
+        if (! published)
+            return false;
+        
+        const BufferType& buffer = mBuffers[front];
+        size_t size = mSize;
+        positions.resize(size);
+        orientations.resize(size);
+        for(size_t i=0; i<size; i++)
+        {
+            positions[i] = Vector3(buffer.mX[i], buffer.mY[i], buffer.mZ[i]);
+            orientations[i] = Quaternion(buffer.mQw[i], buffer.mQx[i], buffer.mQy[i], buffer.mQz[i]);
+        }
+        
+        DOTSCENE_MEMORY_BARRIER();
+        if (sequence == mSequence[front])
+        {
+            if (frame)
+                *frame = published;
+            return true;
+        }
+    }
+    
+    return false;
+}
+//----------------------------------------------------------------------------
+unsigned long DotSceneTransformSnapshot::getFrame() const
+{
+    return mFrames[mFront];
+}
+//----------------------------------------------------------------------------
+size_t DotSceneTransformSnapshot::getMemoryUsage() const
+{
+    return sizeof(DotSceneTransformSnapshot) + mNodes.capacity() * sizeof(SceneNode*) +
+           (mFirstSlots.capacity() + mNextSlots.capacity()) * sizeof(size_t) +
+           2 * mBuffers[0].mX.capacity() * 7 * sizeof(Real);
+}
+//----------------------------------------------------------------------------
+void DotSceneTransformSnapshot::postUpdateSceneGraph(SceneManager* source, Camera* camera)
+{
+    publish(Root::getSingletonPtr()->getNextFrameNumber());
+}
+
+/*****************************************************************************/
+/** DotSceneConstraintEngine (implementation)                                */                   
+/*****************************************************************************/
+DotSceneConstraintEngine::DotSceneConstraintEngine()
+{
+}
+//----------------------------------------------------------------------------
+void DotSceneConstraintEngine::add(SceneNode* node, const String& target, const String& fallback, 
+                                   const Vector3& localDirection, const Vector3& offset)
+{
+    assert(node);
+    
+    PendingType pending;
+    pending.mNode = node;
+    pending.mTarget = target;
+    pending.mFallback = fallback;
+    pending.mLocalDirection = localDirection.normalisedCopy();
+    pending.mOffset = offset;
+    mPending.push_back(pending);
+}
+//----------------------------------------------------------------------------
+void DotSceneConstraintEngine::build(SceneManager* sceneMgr)
+{
+    TRACE_FUNC();
+    
+    //Resolve targets (constraints of a node are replaced by its last one)
+    std::vector<SceneNode*> targets(mPending.size(), (SceneNode*)0);
+    std::map<const Node*, size_t> owners;
+    for(size_t i=0; i<mPending.size(); i++)
+    {
+        if (sceneMgr->hasSceneNode(mPending[i].mTarget))
+            targets[i] = sceneMgr->getSceneNode(mPending[i].mTarget);
+        else if ((StringUtil::BLANK != mPending[i].mFallback) && (sceneMgr->hasSceneNode(mPending[i].mFallback)))
+            targets[i] = sceneMgr->getSceneNode(mPending[i].mFallback);
+        else
+            log("Error: Unknown look/track target node " + mPending[i].mTarget);
+        
+        std::map<const Node*, size_t>::iterator it = owners.find(mPending[i].mNode);
+        if (owners.end() != it)
+            targets[it->second] = 0;
+        owners[mPending[i].mNode] = i;
+    }
+    
+    //Dependency levels: constraints moving a target (or a node parent) are evaluated before
+    std::vector<int> levels(mPending.size(), -2);
+    int maxLevel = -1;
+    for(size_t i=0; i<mPending.size(); i++)
+    {
+        if (targets[i])
+            maxLevel = std::max(maxLevel, getLevel(i, owners, targets, levels));
+    }
+    
+    //Lanes by level (padded to a multiple of 4 lanes)
+    for(int level=0; level<=maxLevel; level++)
+    {
+        mLevels.push_back(mNodes.size());
+        for(size_t i=0; i<mPending.size(); i++)
+        {
+            if ((! targets[i]) || (level != levels[i]))
+                continue;
+            
+            mNodes.push_back(mPending[i].mNode);
+            mTargets.push_back(targets[i]);
+            for(int k=0; k<3; k++)
+            {
+                mDirection[k].push_back(mPending[i].mLocalDirection[k]);
+                mOffset[k].push_back(mPending[i].mOffset[k]);
+            }
+        }
+        while (mNodes.size() % 4)
+        {
+            mNodes.push_back(0);
+            mTargets.push_back(0);
+            for(int k=0; k<3; k++)
+            {
+                mDirection[k].push_back(k? 0.0f: 1.0f);
+                mOffset[k].push_back(0.0f);
+            }
+        }
+    }
+    mLevels.push_back(mNodes.size());
+    
+    //Later levels see orientations solved (not written yet) by previous levels
+    if (maxLevel > 0)
+    {
+        for(size_t i=0; i<mNodes.size(); i++)
+        {
+            if (mNodes[i])
+                mLanes[mNodes[i]] = i;
+        }
+    }
+    
+    for(int k=0; k<4; k++)
+    {
+        if (k < 3) mPosition[k].resize(mNodes.size());
+        if (k < 3) mTarget[k].resize(mNodes.size());
+        mOrientation[k].resize(mNodes.size());
+        mParent[k].resize(mNodes.size());
+        mResult[k].resize(mNodes.size());
+    }
+    mChanged.resize(mNodes.size());
+    
+    mPending.clear();
+    log("Look/track constraints: " + stringify((int)getCount()) + " in " + stringify(maxLevel + 1) + " levels");
+}
+//----------------------------------------------------------------------------
+int DotSceneConstraintEngine::getLevel(size_t pending, const std::map<const Node*, size_t>& owners, 
+                                       const std::vector<SceneNode*>& targets, std::vector<int>& levels) const
+{
+    if (levels[pending] >= 0)
+        return levels[pending];
+    if (-1 == levels[pending])
+    {
+        log("Error: Cyclic look/track constraints on node " + mPending[pending].mNode->getName());
+        return 0;
+    }
+    levels[pending] = -1;
+    
+    int level = 0;
+    const Node* chains[2] = {targets[pending], mPending[pending].mNode->getParent()};
+    for(int c=0; c<2; c++)
+    {
+        for(const Node* node=chains[c]; node; node=node->getParent())
+        {
+            std::map<const Node*, size_t>::const_iterator it = owners.find(node);
+            if ((owners.end() != it) && (pending != it->second) && (targets[it->second]))
+                level = std::max(level, getLevel(it->second, owners, targets, levels) + 1);
+        }
+    }
+    
+    levels[pending] = level;
+    return level;
+}
+//----------------------------------------------------------------------------
+void DotSceneConstraintEngine::clear()
+{
+    mPending.clear();
+    mLevels.clear();
+    mNodes.clear();
+    mTargets.clear();
+    mLanes.clear();
+    for(int k=0; k<4; k++)
+    {
+        if (k < 3) mDirection[k].clear();
+        if (k < 3) mOffset[k].clear();
+        if (k < 3) mPosition[k].clear();
+        if (k < 3) mTarget[k].clear();
+        mOrientation[k].clear();
+        mParent[k].clear();
+        mResult[k].clear();
+    }
+    mChanged.clear();
+}
+//----------------------------------------------------------------------------
+size_t DotSceneConstraintEngine::update()
+{
+    prepare();
+    return apply();
+}
+//----------------------------------------------------------------------------
+void DotSceneConstraintEngine::prepare()
+{
+    std::fill(mChanged.begin(), mChanged.end(), 0);
+    
+    for(size_t l=0; l+1<mLevels.size(); l++)
+    {
+        size_t begin = mLevels[l];
+        size_t end = mLevels[l + 1];
+        
+        gather(begin, end);
+        for(size_t i=begin; i<end; i+=4)
+            solve4(i);
+    }
+}
+//----------------------------------------------------------------------------
+size_t DotSceneConstraintEngine::apply()
+{
+    //Write back changed nodes only
+    size_t written = 0;
+    for(size_t i=0; i<mNodes.size(); i++)
+    {
+        if (! mChanged[i])
+            continue;
+        
+        mNodes[i]->setOrientation(Quaternion(mResult[0][i], mResult[1][i], mResult[2][i], mResult[3][i]));
+        written++;
+    }
+    
+    return written;
+}
+//----------------------------------------------------------------------------
+size_t DotSceneConstraintEngine::getCount() const
+{
+    size_t count = 0;
+    for(size_t i=0; i<mNodes.size(); i++)
+    {
+        if (mNodes[i]) 
+            count++;
+    }
+    return count;
+}
+//----------------------------------------------------------------------------
+size_t DotSceneConstraintEngine::getMemoryUsage() const
+{
+    size_t floats = 0;
+    for(int k=0; k<4; k++)
+    {
+        if (k < 3) floats += mDirection[k].capacity() + mOffset[k].capacity();
+        if (k < 3) floats += mPosition[k].capacity() + mTarget[k].capacity();
+        floats += mOrientation[k].capacity() + mParent[k].capacity() + mResult[k].capacity();
+    }
+    
+    return sizeof(DotSceneConstraintEngine) + 
+           floats * sizeof(float) + 
+           mChanged.capacity() * sizeof(int) + 
+           (mNodes.capacity() + mTargets.capacity()) * sizeof(SceneNode*) + 
+           mLevels.capacity() * sizeof(size_t) + 
+           mLanes.size() * (sizeof(const Node*) + sizeof(size_t) + 4 * sizeof(void*)) + 
+           mPending.capacity() * sizeof(PendingType);
+}
+//----------------------------------------------------------------------------
+void DotSceneConstraintEngine::getSolvedWorldTransform(const Node* node, Vector3& position, 
+                                                       Quaternion& orientation, Vector3& scale) const
+{
+    if (! node)
+    {
+        position = Vector3::ZERO;
+        orientation = Quaternion::IDENTITY;
+        scale = Vector3::UNIT_SCALE;
+        return;
+    }
+    
+    Vector3 parentPosition, parentScale;
+    Quaternion parentOrientation;
+    getSolvedWorldTransform(node->getParent(), parentPosition, parentOrientation, parentScale);
+    
+    Quaternion local = node->getOrientation();
+    std::map<const Node*, size_t>::const_iterator it = mLanes.find(node);
+    if ((mLanes.end() != it) && (mChanged[it->second]))
+        local = Quaternion(mResult[0][it->second], mResult[1][it->second], mResult[2][it->second], mResult[3][it->second]);
+    
+    position = parentPosition + parentOrientation * (parentScale * node->getPosition());
+    orientation = parentOrientation * local;
+    scale = parentScale * node->getScale();
+}
+//----------------------------------------------------------------------------
+void DotSceneConstraintEngine::gather(size_t begin, size_t end)
+{
+    Vector3 position, scale;
+    Quaternion orientation;
+    
+    for(size_t i=begin; i<end; i++)
+    {
+        //Padding lanes: target at node position (never changed)
+        if (! mNodes[i])
+        {
+            for(int k=0; k<4; k++)
+            {
+                if (k < 3) mPosition[k][i] = mTarget[k][i] = 0.0f;
+                mOrientation[k][i] = mParent[k][i] = (k)? 0.0f: 1.0f;
+            }
+            continue;
+        }
+        
+        //Target world position plus offset in target space
+        getSolvedWorldTransform(mTargets[i], position, orientation, scale);
+        Vector3 target = position + orientation * Vector3(mOffset[0][i], mOffset[1][i], mOffset[2][i]);
+        
+        //Node & parent world transforms
+        getSolvedWorldTransform(mNodes[i]->getParent(), position, orientation, scale);
+        Vector3 nodePosition = position + orientation * (scale * mNodes[i]->getPosition());
+        Quaternion nodeOrientation = orientation * mNodes[i]->getOrientation();
+        
+        for(int k=0; k<3; k++)
+        {
+            mPosition[k][i] = nodePosition[k];
+            mTarget[k][i] = target[k];
+        }
+        mOrientation[0][i] = nodeOrientation.w;
+        mOrientation[1][i] = nodeOrientation.x;
+        mOrientation[2][i] = nodeOrientation.y;
+        mOrientation[3][i] = nodeOrientation.z;
+        mParent[0][i] = orientation.w;
+        mParent[1][i] = orientation.x;
+        mParent[2][i] = orientation.y;
+        mParent[3][i] = orientation.z;
+    }
+}
+//----------------------------------------------------------------------------
+void DotSceneConstraintEngine::solve(size_t i)
+{
+    mChanged[i] = 0;
+    
+    //Direction to target
+    float dx = mTarget[0][i] - mPosition[0][i];
+    float dy = mTarget[1][i] - mPosition[1][i];
+    float dz = mTarget[2][i] - mPosition[2][i];
+    float length2 = dx * dx + dy * dy + dz * dz;
+    if (length2 < 1e-8f)
+        return;
+    float inverse = 1.0f / std::sqrt(length2);
+    dx *= inverse; dy *= inverse; dz *= inverse;
+    
+    //Current world direction: local direction rotated by node world orientation
+    float qw = mOrientation[0][i], qx = mOrientation[1][i], qy = mOrientation[2][i], qz = mOrientation[3][i];
+    float lx = mDirection[0][i], ly = mDirection[1][i], lz = mDirection[2][i];
+    float tx = 2.0f * (qy * lz - qz * ly);
+    float ty = 2.0f * (qz * lx - qx * lz);
+    float tz = 2.0f * (qx * ly - qy * lx);
+    float cx = lx + qw * tx + (qy * tz - qz * ty);
+    float cy = ly + qw * ty + (qz * tx - qx * tz);
+    float cz = lz + qw * tz + (qx * ty - qy * tx);
+    
+    //Already aligned: node unchanged
+    float dot = cx * dx + cy * dy + cz * dz;
+    if (dot >= 1.0f - 1e-6f)
+        return;
+    
+    float rw, rx, ry, rz;
+    if (dot <= -1.0f + 1e-6f)
+    {
+        //Opposite: half turn around any axis perpendicular to current direction
+        Vector3 axis = Vector3::UNIT_X.crossProduct(Vector3(cx, cy, cz));
+        if (axis.squaredLength() < 1e-6f)
+            axis = Vector3::UNIT_Y.crossProduct(Vector3(cx, cy, cz));
+        axis.normalise();
+        rw = 0.0f; rx = axis.x; ry = axis.y; rz = axis.z;
+    }
+    else
+    {
+        //Shortest arc
+        float s = std::sqrt((1.0f + dot) * 2.0f);
+        float invs = 1.0f / s;
+        rw = s * 0.5f;
+        rx = (cy * dz - cz * dy) * invs;
+        ry = (cz * dx - cx * dz) * invs;
+        rz = (cx * dy - cy * dx) * invs;
+    }
+    
+    //World orientation: arc * current
+    float ww = rw * qw - rx * qx - ry * qy - rz * qz;
+    float wx = rw * qx + rx * qw + ry * qz - rz * qy;
+    float wy = rw * qy - rx * qz + ry * qw + rz * qx;
+    float wz = rw * qz + rx * qy - ry * qx + rz * qw;
+    
+    //Local orientation: inverse parent (unit: conjugate) * world
+    float pw = mParent[0][i], px = -mParent[1][i], py = -mParent[2][i], pz = -mParent[3][i];
+    float ow = pw * ww - px * wx - py * wy - pz * wz;
+    float ox = pw * wx + px * ww + py * wz - pz * wy;
+    float oy = pw * wy - px * wz + py * ww + pz * wx;
+    float oz = pw * wz + px * wy - py * wx + pz * ww;
+    
+    float norm = 1.0f / std::sqrt(ow * ow + ox * ox + oy * oy + oz * oz);
+    mResult[0][i] = ow * norm;
+    mResult[1][i] = ox * norm;
+    mResult[2][i] = oy * norm;
+    mResult[3][i] = oz * norm;
+    mChanged[i] = 1;
+}
+//----------------------------------------------------------------------------
+void DotSceneConstraintEngine::solve4(size_t i)
+{
+#if DOTSCENE_USE_SSE
+    //Same as solve() for 4 lanes: half turns are solved by scalar path
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 two = _mm_set1_ps(2.0f);
+    const __m128 epsilon = _mm_set1_ps(1e-8f);
+    
+    __m128 dx = _mm_sub_ps(_mm_loadu_ps(&mTarget[0][i]), _mm_loadu_ps(&mPosition[0][i]));
+    __m128 dy = _mm_sub_ps(_mm_loadu_ps(&mTarget[1][i]), _mm_loadu_ps(&mPosition[1][i]));
+    __m128 dz = _mm_sub_ps(_mm_loadu_ps(&mTarget[2][i]), _mm_loadu_ps(&mPosition[2][i]));
+    __m128 length2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+    __m128 valid = _mm_cmpge_ps(length2, epsilon);
+    __m128 inverse = _mm_div_ps(one, _mm_sqrt_ps(_mm_max_ps(length2, epsilon)));
+    dx = _mm_mul_ps(dx, inverse);
+    dy = _mm_mul_ps(dy, inverse);
+    dz = _mm_mul_ps(dz, inverse);
+    
+    __m128 qw = _mm_loadu_ps(&mOrientation[0][i]), qx = _mm_loadu_ps(&mOrientation[1][i]);
+    __m128 qy = _mm_loadu_ps(&mOrientation[2][i]), qz = _mm_loadu_ps(&mOrientation[3][i]);
+    __m128 lx = _mm_loadu_ps(&mDirection[0][i]), ly = _mm_loadu_ps(&mDirection[1][i]);
+    __m128 lz = _mm_loadu_ps(&mDirection[2][i]);
+    __m128 tx = _mm_mul_ps(two, _mm_sub_ps(_mm_mul_ps(qy, lz), _mm_mul_ps(qz, ly)));
+    __m128 ty = _mm_mul_ps(two, _mm_sub_ps(_mm_mul_ps(qz, lx), _mm_mul_ps(qx, lz)));
+    __m128 tz = _mm_mul_ps(two, _mm_sub_ps(_mm_mul_ps(qx, ly), _mm_mul_ps(qy, lx)));
+    __m128 cx = _mm_add_ps(_mm_add_ps(lx, _mm_mul_ps(qw, tx)), _mm_sub_ps(_mm_mul_ps(qy, tz), _mm_mul_ps(qz, ty)));
+    __m128 cy = _mm_add_ps(_mm_add_ps(ly, _mm_mul_ps(qw, ty)), _mm_sub_ps(_mm_mul_ps(qz, tx), _mm_mul_ps(qx, tz)));
+    __m128 cz = _mm_add_ps(_mm_add_ps(lz, _mm_mul_ps(qw, tz)), _mm_sub_ps(_mm_mul_ps(qx, ty), _mm_mul_ps(qy, tx)));
+    
+    __m128 dot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(cx, dx), _mm_mul_ps(cy, dy)), _mm_mul_ps(cz, dz));
+    valid = _mm_and_ps(valid, _mm_cmplt_ps(dot, _mm_set1_ps(1.0f - 1e-6f)));
+    __m128 opposite = _mm_and_ps(valid, _mm_cmple_ps(dot, _mm_set1_ps(-1.0f + 1e-6f)));
+    
+    __m128 s = _mm_sqrt_ps(_mm_max_ps(_mm_mul_ps(_mm_add_ps(one, dot), two), epsilon));
+    __m128 invs = _mm_div_ps(one, s);
+    __m128 rw = _mm_mul_ps(s, _mm_set1_ps(0.5f));
+    __m128 rx = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(cy, dz), _mm_mul_ps(cz, dy)), invs);
+    __m128 ry = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(cz, dx), _mm_mul_ps(cx, dz)), invs);
+    __m128 rz = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(cx, dy), _mm_mul_ps(cy, dx)), invs);
+    
+    __m128 ww = _mm_sub_ps(_mm_sub_ps(_mm_mul_ps(rw, qw), _mm_mul_ps(rx, qx)), _mm_add_ps(_mm_mul_ps(ry, qy), _mm_mul_ps(rz, qz)));
+    __m128 wx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(rw, qx), _mm_mul_ps(rx, qw)), _mm_sub_ps(_mm_mul_ps(ry, qz), _mm_mul_ps(rz, qy)));
+    __m128 wy = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(rw, qy), _mm_mul_ps(rx, qz)), _mm_add_ps(_mm_mul_ps(ry, qw), _mm_mul_ps(rz, qx)));
+    __m128 wz = _mm_add_ps(_mm_sub_ps(_mm_add_ps(_mm_mul_ps(rw, qz), _mm_mul_ps(rx, qy)), _mm_mul_ps(ry, qx)), _mm_mul_ps(rz, qw));
+    
+    __m128 zero = _mm_setzero_ps();
+    __m128 pw = _mm_loadu_ps(&mParent[0][i]);
+    __m128 px = _mm_sub_ps(zero, _mm_loadu_ps(&mParent[1][i]));
+    __m128 py = _mm_sub_ps(zero, _mm_loadu_ps(&mParent[2][i]));
+    __m128 pz = _mm_sub_ps(zero, _mm_loadu_ps(&mParent[3][i]));
+    __m128 ow = _mm_sub_ps(_mm_sub_ps(_mm_mul_ps(pw, ww), _mm_mul_ps(px, wx)), _mm_add_ps(_mm_mul_ps(py, wy), _mm_mul_ps(pz, wz)));
+    __m128 ox = _mm_add_ps(_mm_add_ps(_mm_mul_ps(pw, wx), _mm_mul_ps(px, ww)), _mm_sub_ps(_mm_mul_ps(py, wz), _mm_mul_ps(pz, wy)));
+    __m128 oy = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(pw, wy), _mm_mul_ps(px, wz)), _mm_add_ps(_mm_mul_ps(py, ww), _mm_mul_ps(pz, wx)));
+    __m128 oz = _mm_add_ps(_mm_sub_ps(_mm_add_ps(_mm_mul_ps(pw, wz), _mm_mul_ps(px, wy)), _mm_mul_ps(py, wx)), _mm_mul_ps(pz, ww));
+    
+    __m128 norm2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ow, ow), _mm_mul_ps(ox, ox)), _mm_add_ps(_mm_mul_ps(oy, oy), _mm_mul_ps(oz, oz)));
+    __m128 norm = _mm_div_ps(one, _mm_sqrt_ps(_mm_max_ps(norm2, epsilon)));
+    _mm_storeu_ps(&mResult[0][i], _mm_mul_ps(ow, norm));
+    _mm_storeu_ps(&mResult[1][i], _mm_mul_ps(ox, norm));
+    _mm_storeu_ps(&mResult[2][i], _mm_mul_ps(oy, norm));
+    _mm_storeu_ps(&mResult[3][i], _mm_mul_ps(oz, norm));
+    
+    int changed = _mm_movemask_ps(_mm_andnot_ps(opposite, valid));
+    int half = _mm_movemask_ps(opposite);
+    for(int j=0; j<4; j++)
+    {
+        mChanged[i + j] = (changed >> j) & 1;
+        if ((half >> j) & 1)
+            solve(i + j);
+    }
+#else
+    for(size_t j=0; j<4; j++)
+        solve(i + j);
+#endif
+}
+
+/*****************************************************************************/
+/** DotScenePtr                                                              */                   
+/*****************************************************************************/
+DotScenePtr::DotScenePtr() : SharedPtr<DotScene>() 
+{}
+//----------------------------------------------------------------------------
+DotScenePtr::DotScenePtr(DotScene* scene) : SharedPtr<DotScene>(scene) 
+{}
+//----------------------------------------------------------------------------
+DotScenePtr::DotScenePtr(const DotScenePtr& scenePtr) : SharedPtr<DotScene>(scenePtr) 
+{}
+//----------------------------------------------------------------------------
+DotScenePtr::DotScenePtr(const ResourcePtr& r) 
             : SharedPtr<DotScene>()
 {
     if (r.isNull()) return;
@@ -4269,21 +8522,120 @@ DotSceneManager* DotSceneManager::getSingletonPtr ( void )
 //----------------------------------------------------------------------------
 DotSceneManager& DotSceneManager::getSingleton ( void )
 {
-        assert ( ms_Singleton );
-        return ( *ms_Singleton );
+        assert ( ms_Singleton );
+        return ( *ms_Singleton );
+}
+//----------------------------------------------------------------------------
+DotSceneManager::DotSceneManager()
+               :mVisibilityClock(0), mEnforcingBudget(false), mUpdatePool(0), 
+                mUpdateThreads(std::max((int)boost::thread::hardware_concurrency() - 1, 0)),
+                mHiddenLayers(0)
+{
+    TRACE_FUNC();
+    for(int i=0; i<32; i++)
+        mHiddenLayerUsers[i] = 0;
+    mResourceType = "DotScene";
+    mLoadOrder = 30.0f;
+    ResourceGroupManager::getSingleton()._registerResourceManager(mResourceType, this);
+}
+//----------------------------------------------------------------------------        
+uint32 DotSceneManager::_registerLayer(const String& name, uint32 flags)
+{
+    std::map<String, uint32>::iterator it = mLayers.find(name);
+    if (mLayers.end() != it)
+    {
+        //Declared flags are used by scene objects: kept for declaring scene
+        if ((flags) && (flags != it->second))
+        {
+            log("Warning: Layer " + name + " declared with flags " + stringify((long int)flags) + 
+                ", shared layer uses " + stringify((long int)it->second));
+            return flags;
+        }
+        return it->second;
+    }
+    
+    if (! flags)
+    {
+        uint32 used = 0;
+        for(it=mLayers.begin(); it!=mLayers.end(); it++)
+            used |= it->second;
+        
+        for(int i=31; (i>=0) && (! flags); i--)
+        {
+            if (! (used & (1u << i)))
+                flags = 1u << i;
+        }
+        if (! flags)
+        {
+            log("Error: No free visibility bit for layer " + name);
+            return 0;
+        }
+    }
+    
+    mLayers[name] = flags;
+    return flags;
+}
+//----------------------------------------------------------------------------        
+void DotSceneManager::_setLayersHidden(uint32 flags, bool hidden)
+{
+    //Bits whose hidden state changes (first scene hiding, last scene showing)
+    uint32 changed = 0;
+    for(int i=0; i<32; i++)
+    {
+        if (! (flags & (1u << i)))
+            continue;
+        
+        if (hidden)
+        {
+            if (0 == mHiddenLayerUsers[i]++)
+                changed |= 1u << i;
+        }
+        else if (mHiddenLayerUsers[i])
+        {
+            if (0 == --mHiddenLayerUsers[i])
+                changed |= 1u << i;
+        }
+    }
+    if (! changed)
+        return;
+    
+    mHiddenLayers = (hidden)? (mHiddenLayers | changed): (mHiddenLayers & ~changed);
+    
+    //One mask by viewport: objects aren't touched
+    RenderWindow* window = Root::getSingletonPtr()->getAutoCreatedWindow();
+    if (! window)
+        return;
+    
+    for(unsigned short i=0; i<window->getNumViewports(); i++)
+    {
+        Viewport* viewport = window->getViewport(i);
+        uint32 mask = viewport->getVisibilityMask();
+        viewport->setVisibilityMask((hidden)? (mask & ~changed): (mask | changed));
+    }
 }
-//----------------------------------------------------------------------------
-DotSceneManager::DotSceneManager()
+//----------------------------------------------------------------------------        
+uint32 DotSceneManager::_getHiddenLayers() const
 {
-    TRACE_FUNC();
-    mResourceType = "DotScene";
-    mLoadOrder = 30.0f;
-    ResourceGroupManager::getSingleton()._registerResourceManager(mResourceType, this);
+    return mHiddenLayers;
 }
 //----------------------------------------------------------------------------        
 DotSceneManager::~DotSceneManager()
 {
     TRACE_FUNC();
+    //Scenes notify this manager on unload: release them while members are alive
+    removeAll();
+    
+    if (mUpdatePool)
+        delete mUpdatePool;
+    mUpdatePool = 0;
+    
+    for(std::map<String, DocumentType>::iterator it=mDocuments.begin(); it!=mDocuments.end(); it++)
+        delete it->second.mDocument;
+    mDocuments.clear();
+    
+    ResourceGroupManager* resman = ResourceGroupManager::getSingletonPtr();
+    if ((resman) && (resman->resourceGroupExists(MESH_CACHE_GROUP)))
+        resman->destroyResourceGroup(MESH_CACHE_GROUP);
     ResourceGroupManager::getSingleton()._unregisterResourceManager(mResourceType);
 }
 //----------------------------------------------------------------------------
@@ -4297,7 +8649,8 @@ DotScenePtr DotSceneManager::createScene(const String& name,
                                          const String& namePrefix/*=P4H::StringUtil::BLANK*/,
                                          const String& groupName/*=AUTODETECT_RESOURCE_GROUP_NAME*/,
                                          const SceneManager* sceneManager/*=0*/,
-                                         bool visible/*=true*/
+                                         bool visible/*=true*/,
+                                         const NameValuePairList* options/*=0*/
                                         )
 {
     assert(StringUtil::BLANK != name);
@@ -4332,6 +8685,10 @@ DotScenePtr DotSceneManager::createScene(const String& name,
         values["createSceneMode"] = CREATE_SCENE_MODE_MANUAL;
         if (visible)
             values["createSceneMode"] = CREATE_SCENE_MODE_AUTO;
+        
+        //Scene options (never override previous values)
+        if (options)
+            values.insert(options->begin(), options->end());
     
 
         //Determine ResourceGrpup that contains Resource
@@ -4349,12 +8706,46 @@ DotScenePtr DotSceneManager::createScene(const String& name,
     scenePtr->load();
     
     //Register scene 
-    mScenes.push_back(name);
+    if (mScenes.end() == std::find(mScenes.begin(), mScenes.end(), name))
+        mScenes.push_back(name);
     mCurrentScene = name;
     
+    SceneStateType& state = mSceneStates[name];
+    state.mLastVisible = ++mVisibilityClock;
+    
+    //New scene may exceed memory budget
+    enforceMemoryBudget();
+    
     return scenePtr;
 }
 //----------------------------------------------------------------------------        
+DotScenePtr DotSceneManager::instantiateScene(const DotScenePtr& source,
+                                              const String& name, 
+                                              const String& namePrefix,
+                                              const Vector3& position/*=Vector3::ZERO*/,
+                                              const Quaternion& orientation/*=Quaternion::IDENTITY*/,
+                                              const Vector3& scale/*=Vector3::UNIT_SCALE*/,
+                                              bool visible/*=true*/
+                                             )
+{
+    TRACE_FUNC();
+    assert(! source.isNull());
+    assert(StringUtil::BLANK != namePrefix);
+    assert(getByName(name).isNull());
+    
+    //Same loading policies as source, instances never touch viewports, cameras or environment
+    NameValuePairList options = source->getOptions();
+    options[DOTSCENE_OPTION_APPLY_GLOBAL_STATE] = "false";
+    options[DOTSCENE_OPTION_KEEP_DOCUMENT] = "true";
+    options[DOTSCENE_OPTION_POSITION] = StringConverter::toString(position);
+    options[DOTSCENE_OPTION_ORIENTATION] = StringConverter::toString(orientation);
+    options[DOTSCENE_OPTION_SCALE] = StringConverter::toString(scale);
+    
+    //file, prefix, scene manager & visibility override source values
+    return createScene(name, source->getFile(), namePrefix, source->getGroup(), 
+                       source->getSceneManager(), visible, &options);
+}
+//----------------------------------------------------------------------------        
 void DotSceneManager::destroyScene(const String& name)
 {
     TRACE_FUNC();
@@ -4377,20 +8768,24 @@ void DotSceneManager::destroyScene(const DotScenePtr& scenePtr)
     StringVector::iterator it;
     for(it=mScenes.begin(); it!=mScenes.end();it++)
     {
-        if (name == scenePtr.getPointer()->getName()) break;
+        if (name == *it) break;
     }
     
     //Remove of the list of loaded scenes
     if (mScenes.end() != it)
         mScenes.erase(it);
+    mSceneStates.erase(name);
     //Set current scene to next of list
     mCurrentScene = (mScenes.size())? mScenes.back(): StringUtil::BLANK;    
 }
 //----------------------------------------------------------------------------        
 void DotSceneManager::destroyAllScenes()
 {
+    //destroyScene removes scene from list
+    StringVector scenes = mScenes;
+    
     StringVector::iterator it;
-    for(it=mScenes.begin(); it!=mScenes.end();it++)
+    for(it=scenes.begin(); it!=scenes.end();it++)
     {
         destroyScene(*it);
     }
@@ -4403,8 +8798,451 @@ const DotScenePtr DotSceneManager::getScene(const String& name/*=StringUtil::BLA
     DotScenePtr scenePtr = getByName(name);
     assert(! scenePtr.isNull());
     
+    //Evicted scene: reload transparently (hidden, budget is checked on next visibility change)
+    if (scenePtr->isEvicted())
+        scenePtr->load();
+    
     return scenePtr;
 }
+//----------------------------------------------------------------------------        
+void DotSceneManager::addListener(Listener* listener)
+{
+    assert(listener);
+    if (mListeners.end() == std::find(mListeners.begin(), mListeners.end(), listener))
+        mListeners.push_back(listener);
+}
+//----------------------------------------------------------------------------        
+void DotSceneManager::removeListener(Listener* listener)
+{
+    std::vector<Listener*>::iterator it = std::find(mListeners.begin(), mListeners.end(), listener);
+    if (mListeners.end() != it)
+        mListeners.erase(it);
+}
+//----------------------------------------------------------------------------        
+void DotSceneManager::pinScene(const String& name)
+{
+    mSceneStates[name].mPinned = true;
+}
+//----------------------------------------------------------------------------        
+void DotSceneManager::unpinScene(const String& name)
+{
+    std::map<String, SceneStateType>::iterator it = mSceneStates.find(name);
+    if (mSceneStates.end() != it)
+        it->second.mPinned = false;
+}
+//----------------------------------------------------------------------------        
+bool DotSceneManager::isScenePinned(const String& name) const
+{
+    std::map<String, SceneStateType>::const_iterator it = mSceneStates.find(name);
+    return (mSceneStates.end() != it) && (it->second.mPinned);
+}
+//----------------------------------------------------------------------------        
+/** Functor: order eviction candidates by last visible time */
+struct DotSceneEvictionLess
+{
+    bool operator()(const std::pair<unsigned long, DotScene*>& a, const std::pair<unsigned long, DotScene*>& b) const 
+    { 
+        return a.first < b.first; 
+    }
+};
+//----------------------------------------------------------------------------        
+void DotSceneManager::updateAll(Real delta)
+{
+    std::vector<DotScene*> scenes;
+    for(StringVector::iterator it=mScenes.begin(); it!=mScenes.end(); it++)
+    {
+        DotScenePtr scenePtr = getByName(*it);
+        if ((! scenePtr.isNull()) && (scenePtr->isLoaded()) && (! scenePtr->getSleeping()))
+            scenes.push_back(scenePtr.getPointer());
+    }
+    if (scenes.empty())
+        return;
+    
+    //Shared derived data refreshed before being read concurrently (lazy updates)
+    Root* root = Root::getSingletonPtr();
+    RenderWindow* window = root->getAutoCreatedWindow();
+    if ((window) && (window->getNumViewports()) && (window->getViewport(0)->getCamera()))
+        window->getViewport(0)->getCamera()->getFrustumPlanes();
+    
+    //First phase: scenes solved in parallel (Ogre objects only read)
+    if ((mUpdateThreads) && (scenes.size() > 1))
+    {
+        if (! mUpdatePool)
+            mUpdatePool = new DotSceneUpdatePool(mUpdateThreads);
+        mUpdatePool->run(scenes, delta);
+    }
+    else
+    {
+        for(std::vector<DotScene*>::iterator it=scenes.begin(); it!=scenes.end(); it++)
+            (*it)->_prepareUpdate(delta);
+    }
+    
+    //Second phase: writes to Ogre objects (main thread)
+    for(std::vector<DotScene*>::iterator it=scenes.begin(); it!=scenes.end(); it++)
+        (*it)->_applyUpdate(delta);
+}
+//----------------------------------------------------------------------------
+void DotSceneManager::setUpdateThreadCount(size_t threads)
+{
+    if (threads == mUpdateThreads)
+        return;
+    
+    if (mUpdatePool)
+        delete mUpdatePool;
+    mUpdatePool = 0;
+    mUpdateThreads = threads;
+}
+//----------------------------------------------------------------------------
+size_t DotSceneManager::getUpdateThreadCount() const
+{
+    return mUpdateThreads;
+}
+//----------------------------------------------------------------------------
+size_t DotSceneManager::enforceMemoryBudget()
+{
+    //Unlimited budget (ResourceManager default)
+    if ((mEnforcingBudget) || (getMemoryBudget() >= std::numeric_limits<unsigned long>::max()))
+        return 0;
+    
+    //Sizes cached at load: shared resources are split as they were when each scene loaded
+    size_t usage = DotSceneString::getPoolMemory();
+    for(std::map<String, size_t>::iterator it=mSceneSizes.begin(); it!=mSceneSizes.end(); it++)
+        usage += it->second;
+    if (usage <= getMemoryBudget())
+        return 0;
+    
+    TRACE_FUNC();
+    mEnforcingBudget = true;
+    
+    //Candidates: loaded, hidden & not pinned scenes (least recently visible first)
+    std::vector<std::pair<unsigned long, DotScene*> > candidates;
+    for(StringVector::iterator it=mScenes.begin(); it!=mScenes.end(); it++)
+    {
+        DotScenePtr scenePtr = getByName(*it);
+        //Sleeping scenes are kept resident to wake without reloading
+        if ((scenePtr.isNull()) || (! scenePtr->isLoaded()) || (scenePtr->getVisible()) || (scenePtr->getSleeping()))
+            continue;
+        
+        SceneStateType& state = mSceneStates[*it];
+        if (! state.mPinned)
+            candidates.push_back(std::make_pair(state.mLastVisible, scenePtr.getPointer()));
+    }
+    std::sort(candidates.begin(), candidates.end(), DotSceneEvictionLess());
+    
+    size_t evicted = 0;
+    for(size_t i=0; (i<candidates.size()) && (usage > getMemoryBudget()); i++)
+    {
+        DotScene* scene = candidates[i].second;
+        
+        bool evict = true;
+        for(std::vector<Listener*>::iterator it=mListeners.begin(); it!=mListeners.end(); it++)
+            evict &= (*it)->sceneEvicting(scene);
+        if (! evict)
+            continue;
+        
+        log("Evicting scene " + scene->getName() + " (memory budget)");
+        std::map<String, size_t>::iterator it_size = mSceneSizes.find(scene->getName());
+        if (mSceneSizes.end() != it_size)
+            usage -= std::min(usage, it_size->second);
+        scene->_evict();
+        evicted++;
+        
+        for(std::vector<Listener*>::iterator it=mListeners.begin(); it!=mListeners.end(); it++)
+            (*it)->sceneEvicted(scene);
+    }
+    
+    mEnforcingBudget = false;
+    
+    return evicted;
+}
+//----------------------------------------------------------------------------        
+void DotSceneManager::_notifySceneVisibility(DotScene* scene, bool visible)
+{
+    mSceneStates[scene->getName()].mLastVisible = ++mVisibilityClock;
+    
+    //Scenes being loaded are checked when load finishes
+    if (scene->isLoaded())
+        enforceMemoryBudget();
+}
+//----------------------------------------------------------------------------        
+void DotSceneManager::_notifySceneReloaded(DotScene* scene)
+{
+    //Reloaded scene is in use
+    mSceneStates[scene->getName()].mLastVisible = ++mVisibilityClock;
+    
+    for(std::vector<Listener*>::iterator it=mListeners.begin(); it!=mListeners.end(); it++)
+        (*it)->sceneReloaded(scene);
+}
+//----------------------------------------------------------------------------        
+void DotSceneManager::setMeshCacheDirectory(const String& directory)
+{
+    TRACE_FUNC();
+    
+    ResourceGroupManager* resman = ResourceGroupManager::getSingletonPtr();
+    if (resman->resourceGroupExists(MESH_CACHE_GROUP))
+        resman->destroyResourceGroup(MESH_CACHE_GROUP);
+    mMeshCacheNames.clear();
+    
+    mMeshCacheDirectory = directory;
+    if (StringUtil::BLANK == directory)
+        return;
+    
+    //Files written after initialisation are found by archive lookup (not indexed)
+    resman->createResourceGroup(MESH_CACHE_GROUP);
+    resman->addResourceLocation(directory, "FileSystem", MESH_CACHE_GROUP);
+    resman->initialiseResourceGroup(MESH_CACHE_GROUP);
+}
+//----------------------------------------------------------------------------        
+const String& DotSceneManager::getMeshCacheDirectory() const
+{
+    return mMeshCacheDirectory;
+}
+//----------------------------------------------------------------------------        
+const String& DotSceneManager::_getMeshCacheName(const String& mesh, const String& group)
+{
+    if (StringUtil::BLANK == mMeshCacheDirectory)
+        return StringUtil::BLANK;
+    
+    String key = group + "/" + mesh;
+    std::map<String, String>::iterator it = mMeshCacheNames.find(key);
+    if (mMeshCacheNames.end() != it)
+        return it->second;
+    
+    //Content hash: cache entries of modified meshes are never used
+    String& cacheName = mMeshCacheNames[key];
+    try
+    {
+        DataStreamPtr stream = ResourceGroupManager::getSingleton().openResource(mesh, group);
+        
+        std::ostringstream hash;
+        hash << std::hex << hashStream(stream);
+        stream->close();
+        
+        String name = mesh;
+        std::replace(name.begin(), name.end(), '/', '_');
+        std::replace(name.begin(), name.end(), '\\', '_');
+        cacheName = name + "." + hash.str() + ".mesh";
+    }
+    catch(Exception &e)
+    {
+        log("Error: Mesh cache disabled for " + mesh + " -> " + e.getFullDescription());
+    }
+    
+    return cacheName;
+}
+//----------------------------------------------------------------------------        
+TiXmlDocument* DotSceneManager::_acquireDocument(const String& file, const String& group)
+{
+    TRACE_FUNC();
+    
+    String key = group + "/" + file;
+    std::map<String, DocumentType>::iterator it = mDocuments.find(key);
+    if (mDocuments.end() != it)
+    {
+        it->second.mUsers++;
+        return it->second.mDocument;
+    }
+    
+    //Load & parse scene file
+    TiXmlDocument* doc = 0;
+    try
+    {
+        ResourceGroupManager* resman = ResourceGroupManager::getSingletonPtr();
+        DataStreamPtr pStream = resman->openResource(file, group);
+        
+        String data = pStream->getAsString();
+        pStream->close();
+        pStream.setNull();
+        
+        doc = new TiXmlDocument();
+        doc->Parse( data.c_str() );
+    }
+    catch(...)
+    {
+        log("Error creating TiXmlDocument for file " + file);
+        delete doc;
+        return 0;
+    }
+    
+    //Has parse error
+    if (doc->Error())
+    {
+        log("Error parsing .dotscene resource " + file);
+        delete doc;
+        return 0;
+    }
+    
+    DocumentType document;
+    document.mDocument = doc;
+    document.mUsers = 1;
+    mDocuments.insert(std::make_pair(key, document));
+    
+    return doc;
+}
+//----------------------------------------------------------------------------        
+void DotSceneManager::_releaseDocument(const String& file, const String& group)
+{
+    std::map<String, DocumentType>::iterator it = mDocuments.find(group + "/" + file);
+    assert(mDocuments.end() != it);
+    if (mDocuments.end() == it)
+        return;
+    
+    if (--it->second.mUsers)
+        return;
+    
+    delete it->second.mDocument;
+    mDocuments.erase(it);
+}
+//----------------------------------------------------------------------------        
+DotSceneMemoryBreakdown DotSceneManager::getMemoryBreakdown()
+{
+    DotSceneMemoryBreakdown breakdown;
+    
+    //shared resources are split between its users: sum is counted once
+    ResourceMapIterator it = getResourceIterator();
+    while (it.hasMoreElements())
+    {
+        ResourcePtr resource = it.getNext();
+        if (resource->isLoaded())
+            breakdown += static_cast<DotScene*>(resource.getPointer())->getMemoryBreakdown();
+    }
+    
+    //interned names are shared by all scenes
+    breakdown.mBookkeeping += DotSceneString::getPoolMemory();
+    
+    return breakdown;
+}
+//----------------------------------------------------------------------------        
+size_t DotSceneManager::getResourceUsers(DotSceneResourceType type, const String& name) const
+{
+    assert(type < RESOURCE_TYPE_COUNT);
+    
+    DotSceneString _name;
+    if (! DotSceneString::find(name, _name))
+        return 0;
+    
+    std::map<DotSceneString, size_t>::const_iterator it = mResourceUsers[type].find(_name);
+    return (mResourceUsers[type].end() != it)? it->second: 0;
+}
+//----------------------------------------------------------------------------        
+size_t DotSceneManager::getResourceGroupUsers(const String& group) const
+{
+    std::map<String, size_t>::const_iterator it = mGroupUsers.find(group);
+    return (mGroupUsers.end() != it)? it->second: 0;
+}
+//----------------------------------------------------------------------------        
+void DotSceneManager::_notifyResourcesUsed(DotScene* scene)
+{
+    if (scene->isResourceGroupPrivate())
+        mGroupUsers[scene->getGroup()]++;
+    
+    for(int t=0; t<RESOURCE_TYPE_COUNT; t++)
+    {
+        const DotSceneResourceSet& resources = scene->getResources((DotSceneResourceType)t);
+        for(DotSceneResourceSet::const_iterator it=resources.begin(); it!=resources.end(); it++)
+            mResourceUsers[t][*it]++;
+    }
+    
+    mSceneSizes[scene->getName()] = scene->getMemoryBreakdown().getTotal();
+}
+//----------------------------------------------------------------------------        
+void DotSceneManager::_notifyResourcesReleased(DotScene* scene)
+{
+    mSceneSizes.erase(scene->getName());
+    
+    //Resources without users (released together)
+    std::vector<DotSceneString> released[RESOURCE_TYPE_COUNT];
+    
+    for(int t=0; t<RESOURCE_TYPE_COUNT; t++)
+    {
+        const DotSceneResourceSet& resources = scene->getResources((DotSceneResourceType)t);
+        for(DotSceneResourceSet::const_iterator it=resources.begin(); it!=resources.end(); it++)
+        {
+            std::map<DotSceneString, size_t>::iterator it_users = mResourceUsers[t].find(*it);
+            if (mResourceUsers[t].end() == it_users)
+                continue;
+            
+            if (0 == --it_users->second)
+            {
+                released[t].push_back(*it);
+                mResourceUsers[t].erase(it_users);
+            }
+        }
+    }
+    
+    releaseResources(released);
+    
+    //Private group: release whole group with its last scene
+    if (scene->isResourceGroupPrivate())
+    {
+        std::map<String, size_t>::iterator it = mGroupUsers.find(scene->getGroup());
+        if ((mGroupUsers.end() != it) && (0 == --it->second))
+        {
+            mGroupUsers.erase(it);
+            releaseResourceGroup(scene->getGroup());
+        }
+    }
+}
+//----------------------------------------------------------------------------        
+void DotSceneManager::releaseResources(const std::vector<DotSceneString>* resources)
+{
+    TRACE_FUNC();
+    
+    //Meshes first (reference materials), then materials (reference textures)
+    ResourceManager* managers[] = { MeshManager::getSingletonPtr(), 
+                                    MaterialManager::getSingletonPtr(), 
+                                    TextureManager::getSingletonPtr() };
+    
+    for(int t=RESOURCE_MESH; t<=RESOURCE_TEXTURE; t++)
+    {
+        for(std::vector<DotSceneString>::const_iterator it=resources[t].begin(); it!=resources[t].end(); it++)
+        {
+            ResourcePtr resource = managers[t]->getByName(*it);
+            if (resource.isNull())
+                continue;
+            
+            //Still referenced outside scenes (application objects)
+            if (resource.useCount() > ResourceGroupManager::RESOURCE_SYSTEM_NUM_REFERENCE_COUNTS + 1)
+                continue;
+            
+            //Meshes created by scenes (planes) are rebuilt on next load
+            if (resource->isManual() && (RESOURCE_MESH == t))
+                managers[t]->remove(resource->getHandle());
+            else
+                resource->unload();
+        }
+    }
+    
+    //Particle templates are only counted: Ogre can't parse them again without 
+    //clearing its resource group (scene included)
+}
+//----------------------------------------------------------------------------        
+void DotSceneManager::releaseResourceGroup(const String& group)
+{
+    TRACE_FUNC();
+    log("Releasing private resource group " + group);
+    
+    //unloadUnreferencedResourcesInGroup would also unload other scenes of the group
+    ResourceManager* managers[] = { MeshManager::getSingletonPtr(), 
+                                    SkeletonManager::getSingletonPtr(),
+                                    MaterialManager::getSingletonPtr(), 
+                                    TextureManager::getSingletonPtr() };
+    
+    for(int m=0; m<4; m++)
+    {
+        ResourceMapIterator it = managers[m]->getResourceIterator();
+        while (it.hasMoreElements())
+        {
+            ResourcePtr resource = it.getNext();
+            if ((group != resource->getGroup()) || (! resource->isLoaded()) || (! resource->isReloadable()))
+                continue;
+            
+            //Resources used by other scenes are referenced by its objects: never unloaded
+            if (resource.useCount() <= ResourceGroupManager::RESOURCE_SYSTEM_NUM_REFERENCE_COUNTS + 1)
+                resource->unload();
+        }
+    }
+}
 //----------------------------------------------------------------------------    
 Resource* DotSceneManager::createImpl(const String &name, 
                                             ResourceHandle handle, 
@@ -4431,19 +9269,6 @@ static void log(const String& formatString, ...)
     LogManager::getSingleton().logMessage(String(msg));
 }
 //----------------------------------------------------------------------------
-static String generateUUID(const String& prefix/*=BLANK*/, const String& suffix/*=BLANK*/)
-{
-    boost::uuids::uuid uuid = boost::uuids::random_generator()();
-    std::stringstream ss;
-    ss << uuid;
-
-    String suuid = ss.str();
-    if (prefix.size()) suuid.insert(0,prefix);
-    if (suffix.size()) suuid.append(prefix);
-
-    return suuid;
-}
-//--------------------------------------------------------------------- 
 static bool isPowerOfTwo(int value)
 {
     return (value & (value - 1)) == 0;
@@ -4471,6 +9296,45 @@ static unsigned int nextLargestPowerOfTwo(unsigned int value)
     return value + 1;
 }
 //----------------------------------------------------------------------------
+static void getWorldTransform(const Node* node, Vector3& position, Quaternion& orientation, Vector3& scale)
+{
+    //Composed from local transforms: valid after changes in current frame (no cached derived data)
+    if (! node)
+    {
+        position = Vector3::ZERO;
+        orientation = Quaternion::IDENTITY;
+        scale = Vector3::UNIT_SCALE;
+        return;
+    }
+    
+    Vector3 parentPosition, parentScale;
+    Quaternion parentOrientation;
+    getWorldTransform(node->getParent(), parentPosition, parentOrientation, parentScale);
+    
+    position = parentPosition + parentOrientation * (parentScale * node->getPosition());
+    orientation = parentOrientation * node->getOrientation();
+    scale = parentScale * node->getScale();
+}
+//----------------------------------------------------------------------------
+static uint64 hashStream(DataStreamPtr& stream)
+{
+    //FNV-1a 64 bits
+    uint64 hash = 14695981039346656037ULL;
+    
+    unsigned char buffer[4096];
+    size_t count = 0;
+    while ((count = stream->read(buffer, sizeof(buffer))) > 0)
+    {
+        for(size_t i=0; i<count; i++)
+        {
+            hash ^= buffer[i];
+            hash *= 1099511628211ULL;
+        }
+    }
+    
+    return hash;
+}
+//----------------------------------------------------------------------------
 inline String stringify(double x)
 {
     std::ostringstream o("");